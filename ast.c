@@ -0,0 +1,250 @@
+#include "ast.h"
+#include <string.h>
+#include "cdefs.h"
+#include "cmem.h"
+
+#define AST_INITIAL_CAPACITY 64
+
+/*
+ * Prioridad de cada operador según el nivel de la gramática en que aparece:
+ * <A'> lógicos, <B'> relacionales, <C'> aditivos, <D'> multiplicativos y
+ * <E'> potencia. OPERATOR_NONE marca en la pila de operadores un paréntesis
+ * abierto y detiene las reducciones.
+ */
+const uint8_t ast_precedence[] = {
+    [OPERATOR_NONE] = 0,
+    [OPERATOR_AND] = 1,
+    [OPERATOR_OR] = 1,
+    [OPERATOR_EQ] = 2,
+    [OPERATOR_LT] = 2,
+    [OPERATOR_LE] = 2,
+    [OPERATOR_GT] = 2,
+    [OPERATOR_GE] = 2,
+    [OPERATOR_PLUS] = 3,
+    [OPERATOR_MINUS] = 3,
+    [OPERATOR_MUL] = 4,
+    [OPERATOR_DIV] = 4,
+    [OPERATOR_POW] = 5,
+};
+
+static const char *const ast_operator_texts[] = {
+    [OPERATOR_NONE] = "",
+    [OPERATOR_PLUS] = "+",
+    [OPERATOR_MINUS] = "-",
+    [OPERATOR_MUL] = "*",
+    [OPERATOR_DIV] = "/",
+    [OPERATOR_POW] = "^",
+    [OPERATOR_EQ] = "=",
+    [OPERATOR_LT] = "<",
+    [OPERATOR_LE] = "<=",
+    [OPERATOR_GT] = ">",
+    [OPERATOR_GE] = ">=",
+    [OPERATOR_AND] = "&",
+    [OPERATOR_OR] = "|",
+};
+
+Ast *ast_new(void)
+{
+    Ast *ast = cmalloc(sizeof(*ast));
+    ast->nodes = NULL;
+    ast->count = 0;
+    ast->capacity = 0;
+    ast->text = NULL;
+    ast->text_size = 0;
+    ast->text_capacity = 0;
+    ast->numbers = NULL;
+    ast->number_count = 0;
+    ast->number_capacity = 0;
+    ast->root = AST_NONE;
+    ast->overflow = FALSE;
+    ast->operands = NULL;
+    ast->operand_count = 0;
+    ast->operand_capacity = 0;
+    ast->operators.data = NULL;
+    ast->operators.count = 0;
+    ast->operators.capacity = 0;
+    return ast;
+}
+
+void ast_destroy(Ast *ast)
+{
+    cfree(ast->nodes);
+    cfree(ast->text);
+    cfree(ast->numbers);
+    cfree(ast->operands);
+    cfree(ast->operators.data);
+    cfree(ast);
+}
+
+void ast_reset(Ast *ast)
+{
+    ast->count = 0;
+    ast->text_size = 0;
+    ast->number_count = 0;
+    ast->root = AST_NONE;
+    ast->overflow = FALSE;
+    ast->operand_count = 0;
+    ast->operators.count = 0;
+}
+
+/*
+ * Los índices de los nodos y las posiciones del texto son de 32 bits. Si una
+ * expresión no cabe, el árbol deja de crecer (los nodos que faltan valen
+ * AST_NONE) y ast_finish no lo acepta.
+ */
+static uint32_t ast_overflow(Ast *ast)
+{
+    ast->overflow = TRUE;
+    return AST_NONE;
+}
+
+static uint32_t ast_node_new(Ast *ast, AstKind kind, TokenOperator op,
+                             uint32_t left, uint32_t right)
+{
+    if (ast->count == AST_NONE) {
+        return ast_overflow(ast);
+    }
+
+    if (ast->count == ast->capacity) {
+        ast->nodes = creserve(ast->nodes, &ast->capacity, ast->count + 1,
+                              sizeof(*ast->nodes));
+    }
+
+    AstNode *node = &ast->nodes[ast->count];
+    node->kind = (uint8_t) kind;
+    node->op = (uint8_t) op;
+    node->left = left;
+    node->right = right;
+    return ast->count++;
+}
+
+static void ast_push_operand(Ast *ast, uint32_t node)
+{
+    ast->operands = creserve(ast->operands, &ast->operand_capacity,
+                             ast->operand_count + 1,
+                             sizeof(*ast->operands));
+    ast->operands[ast->operand_count++] = node;
+}
+
+void ast_operators_push(AstOperators *ops, TokenOperator op)
+{
+    ops->data = creserve(ops->data, &ops->capacity, ops->count + 1,
+                         sizeof(*ops->data));
+    ops->data[ops->count++] = (uint8_t) op;
+}
+
+// Combina los dos últimos operandos con el operador retirado
+static void ast_reduce(void *builder, TokenOperator op)
+{
+    Ast *ast = builder;
+    uint32_t right = ast->operands[--ast->operand_count];
+    uint32_t left = ast->operands[ast->operand_count - 1];
+    ast->operands[ast->operand_count - 1] =
+        ast_node_new(ast, AST_BINARY, op, left, right);
+}
+
+void ast_leaf(Ast *ast, const Token *t)
+{
+    if (ast->text_size + t->length > UINT32_MAX) {
+        ast_push_operand(ast, ast_overflow(ast));
+        return;
+    }
+
+    // El texto del token puede no sobrevivir al siguiente bloque de entrada
+    ast->text = creserve(ast->text, &ast->text_capacity,
+                         ast->text_size + t->length, 1);
+    memcpy(ast->text + ast->text_size, t->text, t->length);
+    if (t->type == NUMBER) {
+        ast->numbers = creserve(ast->numbers, &ast->number_capacity,
+                                ast->number_count + 1,
+                                sizeof(*ast->numbers));
+        AstNumber *number = &ast->numbers[ast->number_count];
+        number->value = t->value;
+        number->offset = (uint32_t) ast->text_size;
+        number->length = (uint32_t) t->length;
+        ast_push_operand(ast, ast_node_new(ast, AST_NUMBER, OPERATOR_NONE,
+                                           (uint32_t) ast->number_count++,
+                                           0));
+    } else {
+        ast_push_operand(ast, ast_node_new(ast, AST_IDENTIFIER,
+                                           OPERATOR_NONE,
+                                           (uint32_t) ast->text_size,
+                                           (uint32_t) t->length));
+    }
+
+    ast->text_size += t->length;
+}
+
+void ast_operator(Ast *ast, TokenOperator op)
+{
+    ast_operators_shift(&ast->operators, op, ast_reduce, ast);
+}
+
+void ast_open(Ast *ast)
+{
+    ast_operators_push(&ast->operators, OPERATOR_NONE);
+}
+
+void ast_close(Ast *ast)
+{
+    ast_operators_close(&ast->operators, ast_reduce, ast);
+}
+
+void ast_finish(Ast *ast)
+{
+    ast_operators_finish(&ast->operators, ast_reduce, ast);
+    ast->root = ast->operand_count == 1 && !ast->overflow ? ast->operands[0]
+                                                          : AST_NONE;
+    ast->operand_count = 0;
+}
+
+const char *ast_operator_text(TokenOperator op)
+{
+    return ast_operator_texts[op];
+}
+
+typedef struct {
+    uint32_t node;
+    uint8_t step;           // 0: nodo, 1: su operador, 2: ")"
+} AstPrintItem;
+
+/*
+ * Escribe el subárbol de node en notación infija con todos los paréntesis.
+ * Se recorre con una pila propia: una cadena de operadores que asocian por
+ * la izquierda produce un árbol tan profundo como operadores tenga.
+ */
+void ast_print(const Ast *ast, uint32_t node, FILE *out)
+{
+    size_t capacity = AST_INITIAL_CAPACITY;
+    AstPrintItem *items = cmalloc(capacity * sizeof(*items));
+    size_t count = 0;
+    items[count++] = (AstPrintItem) { node, 0 };
+
+    while (count > 0) {
+        AstPrintItem item = items[--count];
+        const AstNode *n = &ast->nodes[item.node];
+        if (item.step == 1) {
+            fprintf(out, " %s ", ast_operator_texts[n->op]);
+            continue;
+        } else if (item.step == 2) {
+            fputc(')', out);
+            continue;
+        } else if (n->kind == AST_NUMBER) {
+            const AstNumber *number = &ast->numbers[n->left];
+            fwrite(ast->text + number->offset, 1, number->length, out);
+            continue;
+        } else if (n->kind == AST_IDENTIFIER) {
+            fwrite(ast->text + n->left, 1, n->right, out);
+            continue;
+        }
+
+        items = creserve(items, &capacity, count + 4, sizeof(*items));
+        items[count++] = (AstPrintItem) { item.node, 2 };
+        items[count++] = (AstPrintItem) { n->right, 0 };
+        items[count++] = (AstPrintItem) { item.node, 1 };
+        items[count++] = (AstPrintItem) { n->left, 0 };
+        fputc('(', out);
+    }
+
+    cfree(items);
+}
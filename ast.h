@@ -0,0 +1,142 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lexer.h"
+
+// Índice que no corresponde a ningún nodo
+#define AST_NONE UINT32_MAX
+
+// Prioridad de cada TokenOperator; OPERATOR_NONE tiene la menor
+extern const uint8_t ast_precedence[];
+
+typedef enum {
+    AST_NUMBER,
+    AST_IDENTIFIER,
+    AST_BINARY,
+} AstKind;
+
+/*
+ * Los nodos se refieren unos a otros por su índice en Ast.nodes. En los
+ * nodos binarios left y right son los operandos; en los identificadores, la
+ * posición y la longitud de su texto en Ast.text, y en los números, left es
+ * su índice en Ast.numbers.
+ */
+typedef struct {
+    uint8_t kind;           // AstKind
+    uint8_t op;             // TokenOperator de los nodos binarios
+    uint32_t left;
+    uint32_t right;
+} AstNode;
+
+/*
+ * Operadores pendientes del algoritmo de Dijkstra (shunting-yard) con el que
+ * se construyen Ast y Rpn durante el análisis. OPERATOR_NONE marca un
+ * paréntesis abierto. Cada constructor aporta su reducción, que recibe el
+ * operador retirado de la pila.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t count;
+    size_t capacity;
+} AstOperators;
+
+typedef void (*AstReduce)(void *builder, TokenOperator op);
+
+// Literal numérico: el valor que calculó el lexer y su texto en Ast.text
+typedef struct {
+    double value;
+    uint32_t offset;
+    uint32_t length;
+} AstNumber;
+
+/*
+ * Árbol de una expresión, en cinco arreglos que crecen con creserve: los
+ * nodos, el texto de las hojas, los números y las pilas de operandos y
+ * operadores de la construcción. No se usa una CArena porque sus bloques no
+ * crecen ni son contiguos entre sí, y los nodos se localizan por su índice.
+ * ast_reset vacía los arreglos sin liberarlos, que equivale a reiniciar una
+ * arena en cada análisis: tras los primeros, construir el árbol no reserva
+ * memoria.
+ */
+typedef struct {
+    AstNode *nodes;
+    uint32_t count;
+    size_t capacity;
+    char *text;
+    size_t text_size;
+    size_t text_capacity;
+    AstNumber *numbers;
+    size_t number_count;
+    size_t number_capacity;
+    uint32_t root;          // AST_NONE si la expresión no se aceptó
+    int overflow;           // El árbol no cabe en índices de 32 bits
+    uint32_t *operands;
+    size_t operand_count;
+    size_t operand_capacity;
+    AstOperators operators;
+} Ast;
+
+Ast *ast_new(void);
+void ast_destroy(Ast *ast);
+void ast_reset(Ast *ast);
+void ast_leaf(Ast *ast, const Token *t);
+void ast_operator(Ast *ast, TokenOperator op);
+void ast_open(Ast *ast);
+void ast_close(Ast *ast);
+void ast_finish(Ast *ast);
+const char *ast_operator_text(TokenOperator op);
+void ast_print(const Ast *ast, uint32_t node, FILE *out);
+void ast_operators_push(AstOperators *ops, TokenOperator op);
+
+static inline void ast_operators_pop(AstOperators *ops, AstReduce reduce,
+                                     void *builder)
+{
+    reduce(builder, (TokenOperator) ops->data[--ops->count]);
+}
+
+/*
+ * Antes de apilar op se reducen los operadores pendientes de mayor prioridad,
+ * y los de la misma salvo con "^": todos los operadores asocian por la
+ * izquierda menos la potencia. Van en línea para que cada constructor llame a
+ * su reducción directamente.
+ */
+static inline void ast_operators_shift(AstOperators *ops, TokenOperator op,
+                                       AstReduce reduce, void *builder)
+{
+    int precedence = ast_precedence[op];
+    int right = op == OPERATOR_POW;
+    while (ops->count > 0) {
+        int top = ast_precedence[ops->data[ops->count - 1]];
+        if (top < precedence || (top == precedence && right)) {
+            break;
+        }
+
+        ast_operators_pop(ops, reduce, builder);
+    }
+
+    ast_operators_push(ops, op);
+}
+
+// Reduce hasta el paréntesis abierto, que se descarta
+static inline void ast_operators_close(AstOperators *ops, AstReduce reduce,
+                                       void *builder)
+{
+    while (ops->data[ops->count - 1] != OPERATOR_NONE) {
+        ast_operators_pop(ops, reduce, builder);
+    }
+
+    ops->count--;
+}
+
+static inline void ast_operators_finish(AstOperators *ops, AstReduce reduce,
+                                        void *builder)
+{
+    while (ops->count > 0) {
+        ast_operators_pop(ops, reduce, builder);
+    }
+}
+
+#endif
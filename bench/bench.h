@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cmem.h"
+
+// Repeticiones de cada medida; se toma la mejor
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 5
+#endif
+
+static inline double bench_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Carga el archivo completo en memoria; NULL si no se puede leer
+static inline char *bench_read_file(const char *name, size_t *size)
+{
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16;
+    char *data = cmalloc(capacity);
+    *size = 0;
+    size_t nread;
+    while ((nread = fread(data + *size, 1, capacity - *size, f)) > 0) {
+        *size += nread;
+        if (*size == capacity) {
+            capacity *= 2;
+            data = crealloc(data, capacity);
+        }
+    }
+
+    fclose(f);
+    return data;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#include <ctype.h>
+#include <stdio.h>
+#include "bench.h"
+#include "cdefs.h"
+#include "cmem.h"
+#include "lexer.h"
+
+/*
+ * Compara el lexer de tabla con el autómata con switch y ctype al que
+ * sustituyó (lexer_next_token en el commit anterior a [user-003]). Los dos
+ * llenan los mismos lotes de tokens sobre la entrada en memoria, así que la
+ * diferencia es la forma de recorrer el autómata:
+ *
+ *     bench/lexbench ARCHIVO
+ */
+
+typedef enum {
+    BEGIN,
+    NUM1,
+    NUM2,
+    NUM3,
+    NUM4,
+    NUM5,
+    ID,
+    PL,
+    PR,
+    OA,
+    OR1,
+    OR2,
+    OR3,
+    OR4,
+    OR5,
+    OL,
+} RefState;
+
+static const TokenType ref_types[] = {
+    [NUM1] = NUMBER,
+    [NUM2] = NUMBER,
+    [NUM3] = NUMBER,
+    [NUM5] = NUMBER,
+    [ID] = IDENTIFIER,
+    [PL] = PAREN_LEFT,
+    [PR] = PAREN_RIGHT,
+    [OA] = OPERATOR_ARITHMETIC,
+    [OR1] = OPERATOR_RELATIONAL,
+    [OR2] = OPERATOR_RELATIONAL,
+    [OR3] = OPERATOR_RELATIONAL,
+    [OR4] = OPERATOR_RELATIONAL,
+    [OR5] = OPERATOR_RELATIONAL,
+    [OL] = OPERATOR_LOGICAL,
+};
+
+/*
+ * Autómata de referencia: un switch por estado y ctype por carácter, con las
+ * columnas contadas carácter a carácter. Deja cada token en batch, que se
+ * reutiliza al llenarse. Devuelve el número de tokens o 0 si encuentra un
+ * token inválido.
+ */
+static size_t ref_lex(const char *data, size_t size, TokenBatch *batch,
+                      size_t *checksum)
+{
+    RefState state = BEGIN;
+    size_t count = 0;
+    size_t start = 0;
+    size_t i = 0;
+    int line = 0;
+    int column = 0;
+    int token_line = 0;
+    int token_column = 0;
+    batch->count = 0;
+
+    while (TRUE) {
+        int eof = i == size;
+        char c = eof ? ' ' : data[i];
+        int s = eof || isspace((unsigned char) c);
+        int use_char = TRUE;
+        int accept = FALSE;
+
+        switch (state) {
+        case BEGIN:
+            if (eof) {
+                return count;
+            } else if (s) {
+                break;
+            }
+
+            start = i;
+            token_line = line;
+            token_column = column;
+            if (isdigit((unsigned char) c)) {
+                state = NUM1;
+            } else if (c == '.') {
+                state = NUM4;
+            } else if (isalpha((unsigned char) c) || c == '_') {
+                state = ID;
+            } else if (c == '(') {
+                state = PL;
+            } else if (c == ')') {
+                state = PR;
+            } else if (c == '+' || c == '-' || c == '*' || c == '/' ||
+                       c == '^')
+            {
+                state = OA;
+            } else if (c == '=') {
+                state = OR1;
+            } else if (c == '<') {
+                state = OR2;
+            } else if (c == '>') {
+                state = OR4;
+            } else if (c == '&' || c == '|') {
+                state = OL;
+            } else {
+                return 0;
+            }
+
+            break;
+        case NUM1:
+            if (s) {
+                accept = TRUE;
+            } else if (c == '.') {
+                state = NUM2;
+            } else if (!isdigit((unsigned char) c)) {
+                accept = TRUE;
+                use_char = FALSE;
+            }
+
+            break;
+        case NUM2:
+            if (s || !isdigit((unsigned char) c)) {
+                accept = TRUE;
+                use_char = FALSE;
+            } else {
+                state = NUM3;
+            }
+
+            break;
+        case NUM4:
+            if (s || !isdigit((unsigned char) c)) {
+                return 0;
+            }
+
+            state = NUM5;
+            break;
+        case NUM3:
+        case NUM5:
+            if (s || !isdigit((unsigned char) c)) {
+                accept = TRUE;
+                use_char = FALSE;
+            }
+
+            break;
+        case ID:
+            if (s || (!isalnum((unsigned char) c) && c != '_')) {
+                accept = TRUE;
+                use_char = FALSE;
+            }
+
+            break;
+        case OR2:
+        case OR4:
+            if (s || c != '=') {
+                accept = TRUE;
+                use_char = FALSE;
+            } else {
+                state = state == OR2 ? OR3 : OR5;
+            }
+
+            break;
+        default:
+            accept = TRUE;
+            use_char = FALSE;
+            break;
+        }
+
+        if (accept) {
+            size_t n = batch->count++;
+            batch->type[n] = (uint8_t) ref_types[state];
+            batch->text[n] = data + start;
+            batch->length[n] = i - start;
+            batch->line[n] = token_line;
+            batch->column[n] = token_column;
+            *checksum += batch->type[n] * 31 + batch->length[n];
+            count++;
+            state = BEGIN;
+            if (batch->count == batch->capacity) {
+                batch->count = 0;
+            }
+        }
+
+        if (!eof && (s || use_char)) {
+            i++;
+            if (c == '\r' && i < size && data[i] == '\n') {
+                i++;
+            }
+
+            if (c == '\r' || c == '\n') {
+                line++;
+                column = 0;
+            } else {
+                column++;
+            }
+        }
+    }
+}
+
+// Lexer actual sobre la misma entrada
+static size_t table_lex(const char *data, size_t size, TokenBatch *batch,
+                        size_t *checksum)
+{
+    Lexer *lex = lexer_new_buffer(data, size);
+    size_t count = 0;
+    size_t n;
+    while ((n = lexer_next_tokens(lex, batch, batch->capacity)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            *checksum += batch->type[i] * 31 + batch->length[i];
+        }
+
+        count += n;
+    }
+
+    if (lex->error != NULL) {
+        count = 0;
+    }
+
+    lexer_destroy(lex);
+    return count;
+}
+
+typedef size_t (*BenchLex)(const char *data, size_t size, TokenBatch *batch,
+                           size_t *checksum);
+
+static double bench_lex(BenchLex lex, const char *data, size_t size,
+                        TokenBatch *batch, size_t *count, size_t *checksum)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        *checksum = 0;
+        double start = bench_now();
+        *count = lex(data, size, batch, checksum);
+        double elapsed = bench_now() - start;
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Uso: %s ARCHIVO\n", argv[0]);
+        return 2;
+    }
+
+    size_t size;
+    char *data = bench_read_file(argv[1], &size);
+    if (data == NULL) {
+        return 2;
+    }
+
+    TokenBatch *batch = token_batch_new(LEXER_BATCH_SIZE);
+    size_t ref_count;
+    size_t ref_checksum;
+    size_t count;
+    size_t checksum;
+    double ref = bench_lex(ref_lex, data, size, batch, &ref_count,
+                           &ref_checksum);
+    double table = bench_lex(table_lex, data, size, batch, &count,
+                             &checksum);
+    token_batch_destroy(batch);
+    cfree(data);
+
+    if (count == 0 || count != ref_count || checksum != ref_checksum) {
+        fprintf(stderr, "%s: los lexers no coinciden (%zu y %zu tokens) o "
+                "la entrada no es válida\n", argv[1], ref_count, count);
+        return 1;
+    }
+
+    printf("%s: %zu bytes, %zu tokens\n", argv[1], size, count);
+    printf("switch: %8.1f ms  %6.2f ns/token\n", ref * 1e3,
+           ref * 1e9 / count);
+    printf("tabla:  %8.1f ms  %6.2f ns/token  (x%.2f)\n", table * 1e3,
+           table * 1e9 / count, ref / table);
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include "bench.h"
+#include "cdefs.h"
+#include "cmem.h"
+#include "parser.h"
+
+/*
+ * Compara el parser LL(1) dirigido por tabla con el de un switch por no
+ * terminal al que sustituyó (parser_parse en el commit anterior a
+ * [user-008]). Los dos leen los mismos lotes de lexer_next_tokens y usan la
+ * misma ParserStack, así que la diferencia es la forma de elegir la
+ * producción. La entrada debe ser una sola expresión:
+ *
+ *     bench/parsebench ARCHIVO
+ */
+
+typedef struct {
+    Lexer *lex;
+    TokenBatch *batch;
+    ParserStack *stack;
+    size_t next;
+    int has_token;
+    TokenType type;
+    TokenOperator op;
+} RefParser;
+
+static void ref_advance(RefParser *p)
+{
+    if (p->next == p->batch->count) {
+        p->next = 0;
+        if (lexer_next_tokens(p->lex, p->batch, p->batch->capacity) == 0) {
+            p->has_token = FALSE;
+            return;
+        }
+    }
+
+    p->type = p->batch->type[p->next];
+    p->op = p->batch->op[p->next];
+    p->next++;
+    p->has_token = TRUE;
+}
+
+// Sustituye la cima por tail y head (head queda en la cima)
+static void ref_expand(RefParser *p, uint8_t tail, uint8_t head)
+{
+    parser_stack_pop(p->stack, NULL);
+    parser_stack_push(p->stack, tail);
+    parser_stack_push(p->stack, head);
+}
+
+// Primeros de <A>, <B>, <C>, <D> y <E>: id | num | "("
+static int ref_first(RefParser *p)
+{
+    return p->has_token && (p->type == IDENTIFIER || p->type == NUMBER ||
+                            p->type == PAREN_LEFT);
+}
+
+// Siguientes comunes de las producciones ε: <OR> | <OL> | ")" | ¬
+static int ref_follow(RefParser *p)
+{
+    return !p->has_token || p->type == OPERATOR_RELATIONAL ||
+           p->type == OPERATOR_LOGICAL || p->type == PAREN_RIGHT;
+}
+
+// Devuelve TRUE si la entrada es una expresión válida
+static int ref_parse(RefParser *p)
+{
+    parser_stack_clear(p->stack);
+    parser_stack_push(p->stack, PARSER_SYMBOL_BOTTOM);
+    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_A);
+    ref_advance(p);
+
+    while (TRUE) {
+        if (p->lex->error != NULL) {
+            return FALSE;
+        }
+
+        switch (*parser_stack_top(p->stack)) {
+        case PARSER_SYMBOL_BOTTOM:
+            return !p->has_token;
+        case PARSER_SYMBOL_NONTERM_A:
+            if (!ref_first(p)) {
+                return FALSE;
+            }
+
+            ref_expand(p, PARSER_SYMBOL_NONTERM_AP, PARSER_SYMBOL_NONTERM_B);
+            break;
+        case PARSER_SYMBOL_NONTERM_AP:
+            if (!p->has_token || p->type == PAREN_RIGHT) {
+                parser_stack_pop(p->stack, NULL);
+            } else if (p->type == OPERATOR_LOGICAL) {
+                ref_expand(p, PARSER_SYMBOL_NONTERM_AP,
+                           PARSER_SYMBOL_NONTERM_B);
+                ref_advance(p);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_NONTERM_B:
+            if (!ref_first(p)) {
+                return FALSE;
+            }
+
+            ref_expand(p, PARSER_SYMBOL_NONTERM_BP, PARSER_SYMBOL_NONTERM_C);
+            break;
+        case PARSER_SYMBOL_NONTERM_BP:
+            if (p->has_token && p->type == OPERATOR_RELATIONAL) {
+                ref_expand(p, PARSER_SYMBOL_NONTERM_BP,
+                           PARSER_SYMBOL_NONTERM_C);
+                ref_advance(p);
+            } else if (ref_follow(p)) {
+                parser_stack_pop(p->stack, NULL);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_NONTERM_C:
+            if (!ref_first(p)) {
+                return FALSE;
+            }
+
+            ref_expand(p, PARSER_SYMBOL_NONTERM_CP, PARSER_SYMBOL_NONTERM_D);
+            break;
+        case PARSER_SYMBOL_NONTERM_CP:
+            if (p->has_token && p->type == OPERATOR_ARITHMETIC) {
+                if (p->op != OPERATOR_PLUS && p->op != OPERATOR_MINUS) {
+                    return FALSE;
+                }
+
+                ref_expand(p, PARSER_SYMBOL_NONTERM_CP,
+                           PARSER_SYMBOL_NONTERM_D);
+                ref_advance(p);
+            } else if (ref_follow(p)) {
+                parser_stack_pop(p->stack, NULL);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_NONTERM_D:
+            if (!ref_first(p)) {
+                return FALSE;
+            }
+
+            ref_expand(p, PARSER_SYMBOL_NONTERM_DP, PARSER_SYMBOL_NONTERM_E);
+            break;
+        case PARSER_SYMBOL_NONTERM_DP:
+            if (p->has_token && p->type == OPERATOR_ARITHMETIC) {
+                if (p->op == OPERATOR_MUL || p->op == OPERATOR_DIV) {
+                    ref_expand(p, PARSER_SYMBOL_NONTERM_DP,
+                               PARSER_SYMBOL_NONTERM_E);
+                    ref_advance(p);
+                } else if (p->op == OPERATOR_PLUS ||
+                           p->op == OPERATOR_MINUS)
+                {
+                    parser_stack_pop(p->stack, NULL);
+                } else {
+                    return FALSE;
+                }
+            } else if (ref_follow(p)) {
+                parser_stack_pop(p->stack, NULL);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_NONTERM_E:
+            if (!ref_first(p)) {
+                return FALSE;
+            }
+
+            ref_expand(p, PARSER_SYMBOL_NONTERM_EP, PARSER_SYMBOL_NONTERM_F);
+            break;
+        case PARSER_SYMBOL_NONTERM_EP:
+            if (p->has_token && p->type == OPERATOR_ARITHMETIC &&
+                p->op == OPERATOR_POW)
+            {
+                ref_expand(p, PARSER_SYMBOL_NONTERM_EP,
+                           PARSER_SYMBOL_NONTERM_F);
+                ref_advance(p);
+            } else if (ref_follow(p) || p->type == OPERATOR_ARITHMETIC) {
+                parser_stack_pop(p->stack, NULL);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_NONTERM_F:
+            if (!p->has_token) {
+                return FALSE;
+            } else if (p->type == IDENTIFIER || p->type == NUMBER) {
+                parser_stack_pop(p->stack, NULL);
+                ref_advance(p);
+            } else if (p->type == PAREN_LEFT) {
+                ref_expand(p, PARSER_SYMBOL_TERM_RP,
+                           PARSER_SYMBOL_NONTERM_A);
+                ref_advance(p);
+            } else {
+                return FALSE;
+            }
+
+            break;
+        case PARSER_SYMBOL_TERM_RP:
+            if (!p->has_token || p->type != PAREN_RIGHT) {
+                return FALSE;
+            }
+
+            parser_stack_pop(p->stack, NULL);
+            ref_advance(p);
+            break;
+        }
+    }
+}
+
+static int ref_run(const char *data, size_t size)
+{
+    RefParser p;
+    p.lex = lexer_new_buffer(data, size);
+    p.batch = token_batch_new(LEXER_BATCH_SIZE);
+    p.stack = parser_stack_new();
+    p.next = 0;
+    p.batch->count = 0;
+    int accepted = ref_parse(&p);
+    parser_stack_destroy(p.stack);
+    token_batch_destroy(p.batch);
+    lexer_destroy(p.lex);
+    return accepted;
+}
+
+static int table_run(const char *data, size_t size)
+{
+    Parser *p = parser_new(lexer_new_buffer(data, size));
+    parser_parse(p);
+    int accepted = p->error == NULL;
+    parser_destroy_all(p);
+    return accepted;
+}
+
+static double bench_parse(int (*parse)(const char *, size_t),
+                          const char *data, size_t size, int *accepted)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = bench_now();
+        *accepted = parse(data, size);
+        double elapsed = bench_now() - start;
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Uso: %s ARCHIVO\n", argv[0]);
+        return 2;
+    }
+
+    size_t size;
+    char *data = bench_read_file(argv[1], &size);
+    if (data == NULL) {
+        return 2;
+    }
+
+    int ref_accepted;
+    int accepted;
+    double ref = bench_parse(ref_run, data, size, &ref_accepted);
+    double table = bench_parse(table_run, data, size, &accepted);
+    cfree(data);
+
+    if (accepted != ref_accepted) {
+        fprintf(stderr, "%s: los parsers no coinciden (switch %s, tabla "
+                "%s)\n", argv[1], ref_accepted ? "acepta" : "rechaza",
+                accepted ? "acepta" : "rechaza");
+        return 1;
+    }
+
+    printf("%s: %zu bytes, %s\n", argv[1], size,
+           accepted ? "aceptada" : "rechazada");
+    printf("switch: %8.1f ms\n", ref * 1e3);
+    printf("tabla:  %8.1f ms  (x%.2f)\n", table * 1e3, ref / table);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include "ast.h"
+#include "bench.h"
+#include "cdefs.h"
+#include "cmem.h"
+#include "parser.h"
+#include "rpn.h"
+
+/*
+ * Expresiones con paréntesis anidados "(((...x...)))" a profundidades cada
+ * vez mayores: la pila del parser y las de los constructores del árbol y de
+ * la postfija deben crecer sin límite fijo. Termina con error si alguna no se
+ * acepta.
+ */
+
+static const size_t stress_depths[] = { 10, 1000, 100000, 1000000 };
+
+static char *stress_nested(size_t depth, size_t *size)
+{
+    *size = 2 * depth + 1;
+    char *data = cmalloc(*size);
+    memset(data, '(', depth);
+    data[depth] = 'x';
+    memset(data + depth + 1, ')', depth);
+    return data;
+}
+
+// Devuelve TRUE si el parser acepta la expresión
+static int stress_parse(const char *data, size_t size, Ast *ast, Rpn *rpn)
+{
+    Parser *p = parser_new(lexer_new_buffer(data, size));
+    p->ast = ast;
+    p->rpn = rpn;
+    parser_parse(p);
+    int accepted = p->error == NULL;
+    if (!accepted) {
+        fprintf(stderr, "%s\n", p->error->text);
+    }
+
+    parser_destroy_all(p);
+    return accepted;
+}
+
+int main(void)
+{
+    Ast *ast = ast_new();
+    Rpn *rpn = rpn_new();
+    int failed = FALSE;
+
+    for (size_t i = 0; i < sizeof(stress_depths) / sizeof(*stress_depths);
+         i++)
+    {
+        size_t size;
+        char *data = stress_nested(stress_depths[i], &size);
+
+        double start = bench_now();
+        int accepted = stress_parse(data, size, NULL, NULL);
+        double parse = bench_now() - start;
+
+        start = bench_now();
+        accepted = accepted && stress_parse(data, size, ast, rpn);
+        double build = bench_now() - start;
+
+        printf("profundidad %8zu: %s  %8.2f ms  (con árbol y postfija "
+               "%8.2f ms)\n", stress_depths[i],
+               accepted ? "aceptada" : "RECHAZADA", parse * 1e3,
+               build * 1e3);
+        failed = failed || !accepted;
+        cfree(data);
+    }
+
+    rpn_destroy(rpn);
+    ast_destroy(ast);
+    return failed ? 1 : 0;
+}
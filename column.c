@@ -0,0 +1,287 @@
+#include "column.h"
+#include <math.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define COLUMN_HAVE_X86
+#include <immintrin.h>
+#endif
+
+// Operadores sobre un par de valores. Los relacionales y lógicos dan 1.0 o
+// 0.0, como en evaluator_run.
+#define COLUMN_ADD(x, y) ((x) + (y))
+#define COLUMN_SUB(x, y) ((x) - (y))
+#define COLUMN_MUL(x, y) ((x) * (y))
+#define COLUMN_DIV(x, y) ((x) / (y))
+#define COLUMN_POW(x, y) pow((x), (y))
+#define COLUMN_EQ(x, y) (double) ((x) == (y))
+#define COLUMN_LT(x, y) (double) ((x) < (y))
+#define COLUMN_LE(x, y) (double) ((x) <= (y))
+#define COLUMN_GT(x, y) (double) ((x) > (y))
+#define COLUMN_GE(x, y) (double) ((x) >= (y))
+#define COLUMN_AND(x, y) (double) (((x) != 0) & ((y) != 0))
+#define COLUMN_OR(x, y) (double) (((x) != 0) | ((y) != 0))
+
+#define COLUMN_SCALAR(name, OP) \
+    static void column_##name##_vv_scalar(double *out, const double *a, \
+                                          const double *b, size_t n) \
+    { \
+        for (size_t i = 0; i < n; i++) { \
+            out[i] = OP(a[i], b[i]); \
+        } \
+    } \
+    static void column_##name##_vs_scalar(double *out, const double *a, \
+                                          const double *b, size_t n) \
+    { \
+        double y = *b; \
+        for (size_t i = 0; i < n; i++) { \
+            out[i] = OP(a[i], y); \
+        } \
+    } \
+    static void column_##name##_sv_scalar(double *out, const double *a, \
+                                          const double *b, size_t n) \
+    { \
+        double x = *a; \
+        for (size_t i = 0; i < n; i++) { \
+            out[i] = OP(x, b[i]); \
+        } \
+    }
+
+COLUMN_SCALAR(add, COLUMN_ADD)
+COLUMN_SCALAR(sub, COLUMN_SUB)
+COLUMN_SCALAR(mul, COLUMN_MUL)
+COLUMN_SCALAR(div, COLUMN_DIV)
+COLUMN_SCALAR(pow, COLUMN_POW)
+COLUMN_SCALAR(eq, COLUMN_EQ)
+COLUMN_SCALAR(lt, COLUMN_LT)
+COLUMN_SCALAR(le, COLUMN_LE)
+COLUMN_SCALAR(gt, COLUMN_GT)
+COLUMN_SCALAR(ge, COLUMN_GE)
+COLUMN_SCALAR(and, COLUMN_AND)
+COLUMN_SCALAR(or, COLUMN_OR)
+
+static size_t column_select_scalar(const double *values, size_t n,
+                                   uint64_t *bits)
+{
+    size_t count = 0;
+    memset(bits, 0, (n + 63) / 64 * sizeof(*bits));
+    for (size_t i = 0; i < n; i++) {
+        if (values[i] != 0) {
+            bits[i / 64] |= (uint64_t) 1 << (i % 64);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#define COLUMN_TABLE(shape, isa) { \
+    [OPERATOR_PLUS] = column_add_##shape##_##isa, \
+    [OPERATOR_MINUS] = column_sub_##shape##_##isa, \
+    [OPERATOR_MUL] = column_mul_##shape##_##isa, \
+    [OPERATOR_DIV] = column_div_##shape##_##isa, \
+    [OPERATOR_POW] = column_pow_##shape##_scalar, \
+    [OPERATOR_EQ] = column_eq_##shape##_##isa, \
+    [OPERATOR_LT] = column_lt_##shape##_##isa, \
+    [OPERATOR_LE] = column_le_##shape##_##isa, \
+    [OPERATOR_GT] = column_gt_##shape##_##isa, \
+    [OPERATOR_GE] = column_ge_##shape##_##isa, \
+    [OPERATOR_AND] = column_and_##shape##_##isa, \
+    [OPERATOR_OR] = column_or_##shape##_##isa, \
+}
+
+static const ColumnKernels column_kernels_scalar = {
+    {
+        [COLUMN_VV] = COLUMN_TABLE(vv, scalar),
+        [COLUMN_VS] = COLUMN_TABLE(vs, scalar),
+        [COLUMN_SV] = COLUMN_TABLE(sv, scalar),
+    },
+    column_select_scalar,
+};
+
+#ifdef COLUMN_HAVE_X86
+
+/*
+ * Cada núcleo recorre el bloque de W en W valores (2 con SSE2, 4 con AVX) y
+ * deja el resto a la versión escalar. Las comparaciones dan máscaras de todo
+ * unos, que con un AND con 1.0 se convierten en 1.0 o 0.0. "!=" se compara
+ * sin orden, como en C: NaN cuenta como verdadero.
+ */
+#define COLUMN_SIMD(name, OP, isa, vec, W, load, set1, store) \
+    __attribute__((target(#isa))) \
+    static void column_##name##_vv_##isa(double *out, const double *a, \
+                                         const double *b, size_t n) \
+    { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) { \
+            vec x = load(a + i); \
+            vec y = load(b + i); \
+            store(out + i, OP(x, y)); \
+        } \
+        column_##name##_vv_scalar(out + i, a + i, b + i, n - i); \
+    } \
+    __attribute__((target(#isa))) \
+    static void column_##name##_vs_##isa(double *out, const double *a, \
+                                         const double *b, size_t n) \
+    { \
+        size_t i = 0; \
+        vec y = set1(*b); \
+        for (; i + W <= n; i += W) { \
+            vec x = load(a + i); \
+            store(out + i, OP(x, y)); \
+        } \
+        column_##name##_vs_scalar(out + i, a + i, b, n - i); \
+    } \
+    __attribute__((target(#isa))) \
+    static void column_##name##_sv_##isa(double *out, const double *a, \
+                                         const double *b, size_t n) \
+    { \
+        size_t i = 0; \
+        vec x = set1(*a); \
+        for (; i + W <= n; i += W) { \
+            vec y = load(b + i); \
+            store(out + i, OP(x, y)); \
+        } \
+        column_##name##_sv_scalar(out + i, a, b + i, n - i); \
+    }
+
+#define COLUMN_SSE2_BOOL(m) _mm_and_pd((m), _mm_set1_pd(1.0))
+#define COLUMN_SSE2_TRUE(x) _mm_cmpneq_pd((x), _mm_setzero_pd())
+#define COLUMN_SSE2_EQ(x, y) COLUMN_SSE2_BOOL(_mm_cmpeq_pd((x), (y)))
+#define COLUMN_SSE2_LT(x, y) COLUMN_SSE2_BOOL(_mm_cmplt_pd((x), (y)))
+#define COLUMN_SSE2_LE(x, y) COLUMN_SSE2_BOOL(_mm_cmple_pd((x), (y)))
+#define COLUMN_SSE2_GT(x, y) COLUMN_SSE2_BOOL(_mm_cmpgt_pd((x), (y)))
+#define COLUMN_SSE2_GE(x, y) COLUMN_SSE2_BOOL(_mm_cmpge_pd((x), (y)))
+#define COLUMN_SSE2_AND(x, y) \
+    COLUMN_SSE2_BOOL(_mm_and_pd(COLUMN_SSE2_TRUE(x), COLUMN_SSE2_TRUE(y)))
+#define COLUMN_SSE2_OR(x, y) \
+    COLUMN_SSE2_BOOL(_mm_or_pd(COLUMN_SSE2_TRUE(x), COLUMN_SSE2_TRUE(y)))
+
+#define COLUMN_SSE2(name, OP) \
+    COLUMN_SIMD(name, OP, sse2, __m128d, 2, _mm_loadu_pd, _mm_set1_pd, \
+                _mm_storeu_pd)
+
+COLUMN_SSE2(add, _mm_add_pd)
+COLUMN_SSE2(sub, _mm_sub_pd)
+COLUMN_SSE2(mul, _mm_mul_pd)
+COLUMN_SSE2(div, _mm_div_pd)
+COLUMN_SSE2(eq, COLUMN_SSE2_EQ)
+COLUMN_SSE2(lt, COLUMN_SSE2_LT)
+COLUMN_SSE2(le, COLUMN_SSE2_LE)
+COLUMN_SSE2(gt, COLUMN_SSE2_GT)
+COLUMN_SSE2(ge, COLUMN_SSE2_GE)
+COLUMN_SSE2(and, COLUMN_SSE2_AND)
+COLUMN_SSE2(or, COLUMN_SSE2_OR)
+
+__attribute__((target("sse2")))
+static size_t column_select_sse2(const double *values, size_t n,
+                                 uint64_t *bits)
+{
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint64_t word = 0;
+        for (int j = 0; j < 64; j += 2) {
+            __m128d v = _mm_loadu_pd(values + i + j);
+            word |= (uint64_t) _mm_movemask_pd(COLUMN_SSE2_TRUE(v)) << j;
+        }
+
+        bits[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+
+    if (i < n) {
+        count += column_select_scalar(values + i, n - i, bits + i / 64);
+    }
+
+    return count;
+}
+
+static const ColumnKernels column_kernels_sse2 = {
+    {
+        [COLUMN_VV] = COLUMN_TABLE(vv, sse2),
+        [COLUMN_VS] = COLUMN_TABLE(vs, sse2),
+        [COLUMN_SV] = COLUMN_TABLE(sv, sse2),
+    },
+    column_select_sse2,
+};
+
+#define COLUMN_AVX_BOOL(m) _mm256_and_pd((m), _mm256_set1_pd(1.0))
+#define COLUMN_AVX_CMP(x, y, c) COLUMN_AVX_BOOL(_mm256_cmp_pd((x), (y), (c)))
+#define COLUMN_AVX_TRUE(x) _mm256_cmp_pd((x), _mm256_setzero_pd(), _CMP_NEQ_UQ)
+#define COLUMN_AVX_EQ(x, y) COLUMN_AVX_CMP(x, y, _CMP_EQ_OQ)
+#define COLUMN_AVX_LT(x, y) COLUMN_AVX_CMP(x, y, _CMP_LT_OQ)
+#define COLUMN_AVX_LE(x, y) COLUMN_AVX_CMP(x, y, _CMP_LE_OQ)
+#define COLUMN_AVX_GT(x, y) COLUMN_AVX_CMP(x, y, _CMP_GT_OQ)
+#define COLUMN_AVX_GE(x, y) COLUMN_AVX_CMP(x, y, _CMP_GE_OQ)
+#define COLUMN_AVX_AND(x, y) \
+    COLUMN_AVX_BOOL(_mm256_and_pd(COLUMN_AVX_TRUE(x), COLUMN_AVX_TRUE(y)))
+#define COLUMN_AVX_OR(x, y) \
+    COLUMN_AVX_BOOL(_mm256_or_pd(COLUMN_AVX_TRUE(x), COLUMN_AVX_TRUE(y)))
+
+#define COLUMN_AVX(name, OP) \
+    COLUMN_SIMD(name, OP, avx, __m256d, 4, _mm256_loadu_pd, _mm256_set1_pd, \
+                _mm256_storeu_pd)
+
+COLUMN_AVX(add, _mm256_add_pd)
+COLUMN_AVX(sub, _mm256_sub_pd)
+COLUMN_AVX(mul, _mm256_mul_pd)
+COLUMN_AVX(div, _mm256_div_pd)
+COLUMN_AVX(eq, COLUMN_AVX_EQ)
+COLUMN_AVX(lt, COLUMN_AVX_LT)
+COLUMN_AVX(le, COLUMN_AVX_LE)
+COLUMN_AVX(gt, COLUMN_AVX_GT)
+COLUMN_AVX(ge, COLUMN_AVX_GE)
+COLUMN_AVX(and, COLUMN_AVX_AND)
+COLUMN_AVX(or, COLUMN_AVX_OR)
+
+__attribute__((target("avx")))
+static size_t column_select_avx(const double *values, size_t n,
+                                uint64_t *bits)
+{
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint64_t word = 0;
+        for (int j = 0; j < 64; j += 4) {
+            __m256d v = _mm256_loadu_pd(values + i + j);
+            word |= (uint64_t) _mm256_movemask_pd(COLUMN_AVX_TRUE(v)) << j;
+        }
+
+        bits[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+
+    if (i < n) {
+        count += column_select_scalar(values + i, n - i, bits + i / 64);
+    }
+
+    return count;
+}
+
+static const ColumnKernels column_kernels_avx = {
+    {
+        [COLUMN_VV] = COLUMN_TABLE(vv, avx),
+        [COLUMN_VS] = COLUMN_TABLE(vs, avx),
+        [COLUMN_SV] = COLUMN_TABLE(sv, avx),
+    },
+    column_select_avx,
+};
+
+#endif
+
+// Selecciona en tiempo de ejecución los núcleos que admite el procesador
+const ColumnKernels *column_kernels()
+{
+#ifdef COLUMN_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return &column_kernels_avx;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return &column_kernels_sse2;
+    }
+#endif
+    return &column_kernels_scalar;
+}
@@ -0,0 +1,41 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lexer.h"
+
+// Filas que se evalúan de una vez en el modo por columnas; múltiplo de 64
+// para que cada bloque ocupe palabras completas del mapa de selección
+#ifndef COLUMN_BLOCK_SIZE
+#define COLUMN_BLOCK_SIZE 1024
+#endif
+
+#define COLUMN_OPERATOR_COUNT (OPERATOR_OR + 1)
+
+// Formas de los operandos: columna con columna, columna con escalar (b) y
+// escalar (a) con columna. Los escalares se pasan por puntero.
+typedef enum {
+    COLUMN_VV,
+    COLUMN_VS,
+    COLUMN_SV,
+    COLUMN_SHAPE_COUNT,
+} ColumnShape;
+
+// out[i] = a[i] op b[i] para i < n; out puede coincidir con a o con b
+typedef void (*ColumnKernel)(double *out, const double *a, const double *b,
+                             size_t n);
+
+// Pone a 1 en bits los valores distintos de 0 y devuelve cuántos hay. Escribe
+// palabras completas: los bits a partir de n quedan a 0.
+typedef size_t (*ColumnSelectFunc)(const double *values, size_t n,
+                                   uint64_t *bits);
+
+typedef struct {
+    ColumnKernel ops[COLUMN_SHAPE_COUNT][COLUMN_OPERATOR_COUNT];
+    ColumnSelectFunc select;
+} ColumnKernels;
+
+const ColumnKernels *column_kernels();
+
+#endif
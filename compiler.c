@@ -0,0 +1,38 @@
+#include "compiler.h"
+#include <string.h>
+#include "cdefs.h"
+
+// Analiza size bytes de data como una expresión. options puede ser NULL.
+// Devuelve TRUE si la secuencia se acepta; result, si no es NULL, recibe el
+// veredicto y el mensaje de error.
+int parse_buffer(const char *data, size_t size,
+                 const CompilerOptions *options, CompilerResult *result)
+{
+    Lexer *lex = lexer_new_buffer(data, size);
+    if (options != NULL && options->index) {
+        lexer_build_index(lex);
+    }
+
+    Parser *p = parser_new(lex);
+    if (options != NULL) {
+        p->ast = options->ast;
+        p->rpn = options->rpn;
+    }
+
+    parser_parse(p);
+
+    int accepted = p->error == NULL;
+    if (result != NULL) {
+        result->accepted = accepted;
+        if (accepted) {
+            result->error_type = 0;
+            result->error[0] = '\0';
+        } else {
+            result->error_type = p->error->type;
+            memcpy(result->error, p->error->text, sizeof(result->error));
+        }
+    }
+
+    parser_destroy_all(p);
+    return accepted;
+}
@@ -0,0 +1,25 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stddef.h>
+#include "parser.h"
+
+// Interfaz para usar el analizador como biblioteca (libcompiler). No usa
+// estado global ni E/S: puede llamarse a la vez desde varios hilos.
+
+typedef struct {
+    int index;              // Analizar con el índice estructural
+    Ast *ast;               // Si no es NULL, recibe el árbol de la expresión
+    Rpn *rpn;               // Si no es NULL, recibe la expresión en postfija
+} CompilerOptions;
+
+typedef struct {
+    int accepted;
+    ParserErrorType error_type;     // Solo si !accepted
+    char error[128];                // Mensaje de error, como en c-ompiler
+} CompilerResult;
+
+int parse_buffer(const char *data, size_t size,
+                 const CompilerOptions *options, CompilerResult *result);
+
+#endif
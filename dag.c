@@ -0,0 +1,190 @@
+#include "dag.h"
+#include <string.h>
+#include "ast.h"
+#include "cdefs.h"
+#include "cmem.h"
+
+#define DAG_INITIAL_CAPACITY 64
+
+Dag *dag_new(void)
+{
+    Dag *dag = cmalloc(sizeof(*dag));
+    dag->nodes = NULL;
+    dag->count = 0;
+    dag->capacity = 0;
+    dag->table_size = DAG_INITIAL_CAPACITY;
+    dag->table = ccalloc(dag->table_size, sizeof(*dag->table));
+    dag->ids = NULL;
+    dag->stack = NULL;
+    dag->id_capacity = 0;
+    dag->shared = 0;
+    dag->root = DAG_NONE;
+    return dag;
+}
+
+void dag_destroy(Dag *dag)
+{
+    cfree(dag->nodes);
+    cfree(dag->table);
+    cfree(dag->ids);
+    cfree(dag->stack);
+    cfree(dag);
+}
+
+static uint32_t dag_hash(uint8_t kind, uint8_t op, uint32_t left,
+                         uint32_t right)
+{
+    uint64_t key = ((uint64_t) left << 32 | right) ^
+                   (uint64_t) (kind << 8 | op) << 56;
+    key *= 0x9e3779b97f4a7c15u;
+    return (uint32_t) (key >> 32);
+}
+
+// Hueco de la clave en la tabla: el que la contiene o el vacío donde iría
+static uint32_t *dag_slot(const Dag *dag, uint8_t kind, uint8_t op,
+                          uint32_t left, uint32_t right)
+{
+    uint32_t mask = dag->table_size - 1;
+    uint32_t i = dag_hash(kind, op, left, right) & mask;
+    while (dag->table[i] != 0) {
+        const DagNode *n = &dag->nodes[dag->table[i] - 1];
+        if (n->kind == kind && n->op == op && n->left == left &&
+            n->right == right)
+        {
+            break;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return &dag->table[i];
+}
+
+// Duplica la tabla cuando se llena a la mitad
+static void dag_grow_table(Dag *dag)
+{
+    cfree(dag->table);
+    dag->table_size *= 2;
+    dag->table = ccalloc(dag->table_size, sizeof(*dag->table));
+    for (uint32_t i = 0; i < dag->count; i++) {
+        const DagNode *n = &dag->nodes[i];
+        *dag_slot(dag, n->kind, n->op, n->left, n->right) = i + 1;
+    }
+}
+
+// Devuelve el nodo con esa clave, creándolo si aún no existe
+static uint32_t dag_intern(Dag *dag, uint8_t kind, uint8_t op, uint32_t left,
+                           uint32_t right)
+{
+    uint32_t *slot = dag_slot(dag, kind, op, left, right);
+    if (*slot != 0) {
+        return *slot - 1;
+    }
+
+    if (dag->count == dag->capacity) {
+        dag->nodes = creserve(dag->nodes, &dag->capacity, dag->count + 1,
+                              sizeof(*dag->nodes));
+    }
+
+    DagNode *n = &dag->nodes[dag->count];
+    n->kind = kind;
+    n->op = op;
+    n->left = left;
+    n->right = right;
+    n->parents = 0;
+    if (kind == RPN_OPERATOR) {
+        dag->nodes[left].parents++;
+        dag->nodes[right].parents++;
+    }
+
+    *slot = ++dag->count;
+    if (dag->count * 2 >= dag->table_size) {
+        dag_grow_table(dag);
+    }
+
+    return dag->count - 1;
+}
+
+/*
+ * Construye el grafo de rpn recorriendo sus instrucciones con una pila de
+ * nodos, como el evaluador con los valores. Devuelve FALSE si la expresión no
+ * se aceptó.
+ */
+int dag_build(Dag *dag, const Rpn *rpn)
+{
+    if (dag->count > 0) {
+        memset(dag->table, 0, dag->table_size * sizeof(*dag->table));
+    }
+
+    dag->count = 0;
+    dag->shared = 0;
+    dag->root = DAG_NONE;
+    if (!rpn->complete) {
+        return FALSE;
+    }
+
+    if (rpn->count > dag->id_capacity) {
+        dag->id_capacity = rpn->count;
+        dag->ids = crealloc(dag->ids, rpn->count * sizeof(*dag->ids));
+        dag->stack = crealloc(dag->stack, rpn->count * sizeof(*dag->stack));
+    }
+
+    uint32_t *top = dag->stack - 1;
+    for (uint32_t i = 0; i < rpn->count; i++) {
+        const RpnInstruction *ins = &rpn->code[i];
+        uint32_t id;
+        if (ins->kind == RPN_NUMBER) {
+            uint64_t bits;
+            memcpy(&bits, &rpn->numbers[ins->arg], sizeof(bits));
+            id = dag_intern(dag, RPN_NUMBER, OPERATOR_NONE, (uint32_t) bits,
+                            (uint32_t) (bits >> 32));
+            *++top = id;
+        } else if (ins->kind == RPN_IDENTIFIER) {
+            id = dag_intern(dag, RPN_IDENTIFIER, OPERATOR_NONE, ins->arg, 0);
+            *++top = id;
+        } else {
+            id = dag_intern(dag, RPN_OPERATOR, ins->op, top[-1], top[0]);
+            *--top = id;
+        }
+
+        dag->ids[i] = id;
+    }
+
+    for (uint32_t i = 0; i < dag->count; i++) {
+        const DagNode *n = &dag->nodes[i];
+        if (n->kind == RPN_OPERATOR && n->parents > 1) {
+            dag->shared++;
+        }
+    }
+
+    dag->root = *top;
+    return TRUE;
+}
+
+double dag_number(const DagNode *node)
+{
+    uint64_t bits = (uint64_t) node->right << 32 | node->left;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Un nodo por línea lógica: "n2 = n0 + n1", separados por "; "
+void dag_print(const Dag *dag, const Rpn *rpn, FILE *out)
+{
+    for (uint32_t i = 0; i < dag->count; i++) {
+        const DagNode *n = &dag->nodes[i];
+        fprintf(out, i > 0 ? "; n%u = " : "n%u = ", (unsigned) i);
+        if (n->kind == RPN_NUMBER) {
+            char number[RPN_NUMBER_TEXT];
+            rpn_format_number(number, dag_number(n));
+            fputs(number, out);
+        } else if (n->kind == RPN_IDENTIFIER) {
+            const RpnName *name = &rpn->names[n->left];
+            fwrite(rpn->text + name->offset, 1, name->length, out);
+        } else {
+            fprintf(out, "n%u %s n%u", (unsigned) n->left,
+                    ast_operator_text(n->op), (unsigned) n->right);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "rpn.h"
+
+// Índice que no corresponde a ningún nodo
+#define DAG_NONE UINT32_MAX
+
+/*
+ * En los nodos RPN_OPERATOR left y right son los índices de los operandos.
+ * Las hojas guardan su clave: el índice del identificador en la tabla de
+ * nombres del Rpn, o los 64 bits del número repartidos entre left (bajos) y
+ * right (altos), de modo que dos literales con el mismo valor son un mismo
+ * nodo (pero 0 y -0 no).
+ */
+typedef struct {
+    uint8_t kind;           // RpnKind
+    uint8_t op;             // TokenOperator de RPN_OPERATOR
+    uint32_t left;
+    uint32_t right;
+    uint32_t parents;       // Nodos que lo usan como operando (con repetición)
+} DagNode;
+
+/*
+ * Grafo de una expresión con los subárboles iguales compartidos. Cada nodo se
+ * crea una sola vez: antes de añadirlo se busca su clave (tipo, operador,
+ * hijos) en una tabla de direccionamiento abierto. Como en Rpn, dag_build
+ * reutiliza la memoria de la construcción anterior.
+ */
+typedef struct {
+    DagNode *nodes;         // Cada nodo va detrás de sus operandos
+    uint32_t count;
+    size_t capacity;
+    uint32_t *table;        // Índices de nodes + 1 por hash de la clave
+    uint32_t table_size;
+    uint32_t *ids;          // Nodo de cada instrucción del Rpn
+    uint32_t *stack;        // Nodos pendientes durante la construcción
+    uint32_t id_capacity;   // De ids y de stack
+    uint32_t shared;        // Operadores con más de un padre
+    uint32_t root;          // DAG_NONE si la expresión no se aceptó
+} Dag;
+
+Dag *dag_new(void);
+void dag_destroy(Dag *dag);
+int dag_build(Dag *dag, const Rpn *rpn);
+double dag_number(const DagNode *node);
+void dag_print(const Dag *dag, const Rpn *rpn, FILE *out);
+
+#endif
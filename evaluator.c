@@ -0,0 +1,607 @@
+#include "evaluator.h"
+#include <math.h>
+#include <string.h>
+#include "cdefs.h"
+#include "cmem.h"
+#include "jit.h"
+
+Evaluator *evaluator_new(void)
+{
+    Evaluator *ev = cmalloc(sizeof(*ev));
+    ev->code = NULL;
+    ev->count = 0;
+    ev->capacity = 0;
+    ev->slots = NULL;
+    ev->slot_count = 0;
+    ev->slot_capacity = 0;
+    ev->number_count = 0;
+    ev->stack = NULL;
+    ev->depth = 0;
+    ev->stack_capacity = 0;
+    ev->rpn = NULL;
+    ev->dag = dag_new();
+    ev->node_slots = NULL;
+    ev->node_capacity = 0;
+    ev->spans = NULL;
+    ev->span_capacity = 0;
+    ev->jumps = NULL;
+    ev->jump_capacity = 0;
+    ev->jump_depth = 0;
+    ev->kernels = column_kernels();
+    ev->operands = NULL;
+    ev->blocks = NULL;
+    ev->block_capacity = 0;
+    ev->selections = NULL;
+    ev->selection_capacity = 0;
+    ev->jit = NULL;
+    ev->runs = 0;
+    ev->jit_after = EVALUATOR_JIT_AFTER;
+    return ev;
+}
+
+void evaluator_destroy(Evaluator *ev)
+{
+    cfree(ev->code);
+    cfree(ev->slots);
+    cfree(ev->stack);
+    dag_destroy(ev->dag);
+    cfree(ev->node_slots);
+    cfree(ev->spans);
+    cfree(ev->jumps);
+    cfree(ev->operands);
+    cfree(ev->blocks);
+    for (uint32_t i = 0; i < ev->selection_capacity; i++) {
+        EvaluatorSelection *s = &ev->selections[i];
+        cfree(s->vars);
+        cfree(s->gathered);
+        cfree(s->blocks);
+        cfree(s->rows);
+    }
+
+    cfree(ev->selections);
+    if (ev->jit != NULL) {
+        jit_destroy(ev->jit);
+    }
+
+    cfree(ev);
+}
+
+/*
+ * Traduce rpn a instrucciones del evaluador. Un operador compartido se
+ * guarda la primera vez que se calcula; si vuelve a aparecer, su código (que
+ * ya se había copiado) se retira y se carga el hueco. Todo lo que contenía
+ * apareció ya dentro de la primera copia, así que cada nodo se calcula una
+ * vez.
+ */
+static void evaluator_emit(Evaluator *ev, const Rpn *rpn)
+{
+    const Dag *dag = ev->dag;
+    EvaluatorSpan *span = ev->spans - 1;
+    uint32_t shared_slot = ev->shared_slot;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < rpn->count; i++) {
+        const RpnInstruction *ins = &rpn->code[i];
+        EvaluatorInstruction *out = &ev->code[count];
+        if (ins->kind != RPN_OPERATOR) {
+            (++span)->start = count++;
+            out->op = OPERATOR_NONE;
+            out->slot = ins->kind == RPN_NUMBER ? ins->arg
+                                                : rpn->number_count + ins->arg;
+            continue;
+        }
+
+        // El resultado empieza donde empezaba el operando izquierdo
+        span--;
+        uint32_t id = dag->ids[i];
+        if (ev->node_slots[id] != DAG_NONE) {
+            count = span->start;
+            ev->code[count].op = OPERATOR_NONE;
+            ev->code[count++].slot = ev->node_slots[id];
+            continue;
+        }
+
+        out->op = ins->op;
+        out->slot = 0;
+        count++;
+        if (dag->nodes[id].parents > 1) {
+            ev->node_slots[id] = shared_slot;
+            ev->code[count].op = EVALUATOR_STORE;
+            ev->code[count++].slot = shared_slot++;
+        }
+    }
+
+    ev->count = count;
+}
+
+/*
+ * Pone un salto delante del operando derecho de cada "&" y "|" y cambia el
+ * operador por EVALUATOR_TRUTH. Primero se marcan en jumps el inicio r del
+ * operando derecho (con el índice i del operador) y el operador (con r);
+ * después se abre hueco para los saltos recorriendo el código hacia atrás,
+ * de modo que cada operador se mueve antes de que haga falta su destino.
+ */
+static void evaluator_short_circuit(Evaluator *ev)
+{
+    EvaluatorInstruction *code = ev->code;
+    uint32_t *jumps = ev->jumps;
+    EvaluatorSpan *span = ev->spans - 1;
+    uint32_t stores = 0;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < ev->count; i++) {
+        unsigned op = code[i].op;
+        jumps[i] = DAG_NONE;
+        if (op == OPERATOR_NONE) {
+            span++;
+            span->start = i;
+            span->stores = stores;
+        } else if (op == EVALUATOR_STORE) {
+            stores++;
+        } else {
+            // Un resultado compartido no puede quedar sin calcular
+            if ((op == OPERATOR_AND || op == OPERATOR_OR) &&
+                span->stores == stores)
+            {
+                jumps[span->start] = i;
+                jumps[i] = span->start;
+                count++;
+            }
+
+            span--;
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t total = count;
+    ev->code = creserve(ev->code, &ev->capacity, ev->count + count,
+                        sizeof(*ev->code));
+    code = ev->code;
+    for (uint32_t i = ev->count; i-- > 0;) {
+        EvaluatorInstruction ins = code[i];
+        if (jumps[i] != DAG_NONE && ins.op != OPERATOR_NONE) {
+            jumps[i] = i + count + 1;
+            code[i + count].op = EVALUATOR_TRUTH;
+            code[i + count].slot = ins.op;
+            continue;
+        }
+
+        code[i + count] = ins;
+        if (jumps[i] != DAG_NONE) {
+            uint32_t target = jumps[jumps[i]];
+            count--;
+            code[i + count].op = code[target - 1].slot == OPERATOR_AND ?
+                                 EVALUATOR_JUMP_FALSE : EVALUATOR_JUMP_TRUE;
+            code[i + count].slot = target;
+        }
+    }
+
+    ev->count += total;
+}
+
+/*
+ * Prepara la evaluación de rpn, que debe seguir existiendo mientras se use
+ * el evaluador. Los identificadores quedan sin valor (NaN). Devuelve FALSE si
+ * la expresión no se aceptó.
+ */
+int evaluator_load(Evaluator *ev, const Rpn *rpn)
+{
+    const Dag *dag = ev->dag;
+    if (!dag_build(ev->dag, rpn)) {
+        return FALSE;
+    }
+
+    if (ev->jit != NULL) {
+        jit_destroy(ev->jit);
+        ev->jit = NULL;
+    }
+
+    ev->runs = 0;
+    ev->rpn = rpn;
+    ev->number_count = rpn->number_count;
+    ev->shared_slot = rpn->number_count + rpn->name_count;
+    ev->slot_count = ev->shared_slot + dag->shared;
+    ev->slots = creserve(ev->slots, &ev->slot_capacity,
+                         ev->slot_count, sizeof(*ev->slots));
+    for (uint32_t i = 0; i < rpn->number_count; i++) {
+        ev->slots[i] = rpn->numbers[i];
+    }
+
+    for (uint32_t i = rpn->number_count; i < ev->slot_count; i++) {
+        ev->slots[i] = NAN;
+    }
+
+    // Cada guardado sigue a un operador, que no se retira con él
+    ev->code = creserve(ev->code, &ev->capacity,
+                        rpn->count + dag->shared, sizeof(*ev->code));
+    ev->node_slots = creserve(ev->node_slots, &ev->node_capacity,
+                              dag->count, sizeof(*ev->node_slots));
+    ev->spans = creserve(ev->spans, &ev->span_capacity,
+                         rpn->count, sizeof(*ev->spans));
+    ev->jumps = creserve(ev->jumps, &ev->jump_capacity,
+                         rpn->count + dag->shared,
+                         sizeof(*ev->jumps));
+    for (uint32_t i = 0; i < dag->count; i++) {
+        ev->node_slots[i] = DAG_NONE;
+    }
+
+    evaluator_emit(ev, rpn);
+    evaluator_short_circuit(ev);
+
+    // Profundidad de la pila y de los cortocircuitos; spans guarda el
+    // destino de los saltos que siguen abiertos. Se cuenta el operando
+    // izquierdo como si siguiera en la pila mientras se evalúa el derecho,
+    // como hace el modo por columnas cuando no todas las filas siguen igual
+    uint32_t depth = 0;
+    uint32_t jumps = 0;
+    ev->depth = 0;
+    ev->jump_depth = 0;
+    for (uint32_t i = 0; i < ev->count; i++) {
+        unsigned op = ev->code[i].op;
+        while (jumps > 0 && ev->spans[jumps - 1].start <= i) {
+            jumps--;
+        }
+
+        if (op == OPERATOR_NONE) {
+            depth++;
+        } else if (op == EVALUATOR_JUMP_FALSE || op == EVALUATOR_JUMP_TRUE) {
+            ev->spans[jumps++].start = ev->code[i].slot;
+            if (jumps > ev->jump_depth) {
+                ev->jump_depth = jumps;
+            }
+        } else if (op != EVALUATOR_STORE) {
+            depth--;
+        }
+
+        if (depth > ev->depth) {
+            ev->depth = depth;
+        }
+    }
+
+    ev->stack = creserve(ev->stack, &ev->stack_capacity, ev->depth,
+                         sizeof(*ev->stack));
+    return TRUE;
+}
+
+// Devuelve FALSE si el identificador no aparece en la expresión cargada
+int evaluator_bind(Evaluator *ev, const char *name, size_t length,
+                   double value)
+{
+    uint32_t index = rpn_find_name(ev->rpn, name, length);
+    if (index == RPN_NONE) {
+        return FALSE;
+    }
+
+    *evaluator_value(ev, index) = value;
+    return TRUE;
+}
+
+double evaluator_interpret(Evaluator *ev)
+{
+    const EvaluatorInstruction *code = ev->code;
+    double *slots = ev->slots;
+    double *top = ev->stack - 1;
+
+    for (uint32_t i = 0; i < ev->count; i++) {
+        unsigned op = code[i].op;
+        if (op == OPERATOR_NONE) {
+            *++top = slots[code[i].slot];
+        } else if (op < COLUMN_OPERATOR_COUNT) {
+            top[-1] = evaluator_apply(op, top[-1], top[0]);
+            top--;
+        } else if (op == EVALUATOR_STORE) {
+            slots[code[i].slot] = *top;
+        } else if (op == EVALUATOR_TRUTH) {
+            *top = *top != 0;
+        } else if ((*top != 0) == (op == EVALUATOR_JUMP_TRUE)) {
+            *top = op == EVALUATOR_JUMP_TRUE;
+            i = code[i].slot - 1;
+        } else {
+            top--;
+        }
+    }
+
+    return *top;
+}
+
+double evaluator_run(Evaluator *ev)
+{
+    if (ev->jit != NULL) {
+        return ev->jit->func(ev->slots);
+    }
+
+    if (ev->jit_after != 0 && ++ev->runs == ev->jit_after) {
+        ev->jit = jit_compile(ev->code, ev->count, ev->depth);
+    }
+
+    return evaluator_interpret(ev);
+}
+
+// Bloques para los resultados intermedios, el del modo de selección y los
+// compartidos, y niveles de cortocircuito
+static void evaluator_reserve_blocks(Evaluator *ev)
+{
+    uint32_t need = ev->depth + 1 + (ev->slot_count - ev->shared_slot);
+    if (need > ev->block_capacity) {
+        cfree(ev->blocks);
+        cfree(ev->operands);
+        ev->blocks = cmalloc((size_t) need * COLUMN_BLOCK_SIZE *
+                             sizeof(*ev->blocks));
+        ev->operands = cmalloc(need * sizeof(*ev->operands));
+        ev->block_capacity = need;
+    }
+
+    uint32_t levels = ev->jump_depth + 1;
+    if (levels > ev->selection_capacity) {
+        ev->selections = crealloc(ev->selections,
+                                  levels * sizeof(*ev->selections));
+        for (uint32_t i = ev->selection_capacity; i < levels; i++) {
+            EvaluatorSelection *s = &ev->selections[i];
+            s->vars = NULL;
+            s->gathered = NULL;
+            s->blocks = NULL;
+            s->var_capacity = 0;
+            s->rows = cmalloc(COLUMN_BLOCK_SIZE * sizeof(*s->rows));
+            s->row_count = 0;
+            s->compact = FALSE;
+        }
+
+        ev->selection_capacity = levels;
+    }
+
+    uint32_t vars = ev->slot_count - ev->number_count;
+    for (uint32_t i = 0; i < levels; i++) {
+        EvaluatorSelection *s = &ev->selections[i];
+        if (vars > s->var_capacity) {
+            cfree(s->vars);
+            cfree(s->gathered);
+            cfree(s->blocks);
+            s->vars = cmalloc(vars * sizeof(*s->vars));
+            s->gathered = cmalloc(vars);
+            s->blocks = NULL;
+            s->var_capacity = vars;
+        }
+    }
+}
+
+// Operando j de vars en el nivel level, copiando las filas que quedan del
+// nivel anterior si aún no se había cargado
+static const EvaluatorOperand *evaluator_var(Evaluator *ev, uint32_t level,
+                                             uint32_t j)
+{
+    EvaluatorSelection *s = &ev->selections[level];
+    if (level == 0 || s->gathered[j]) {
+        return &s->vars[j];
+    }
+
+    const EvaluatorOperand *v = evaluator_var(ev, level - 1, j);
+    s->vars[j] = *v;
+    s->gathered[j] = TRUE;
+    if (v->values != NULL && s->compact) {
+        if (s->blocks == NULL) {
+            s->blocks = cmalloc((size_t) s->var_capacity * COLUMN_BLOCK_SIZE *
+                                sizeof(*s->blocks));
+        }
+
+        double *block = s->blocks + (size_t) j * COLUMN_BLOCK_SIZE;
+        for (size_t m = 0; m < s->row_count; m++) {
+            block[m] = v->values[s->rows[m]];
+        }
+
+        s->vars[j].values = block;
+    }
+
+    return &s->vars[j];
+}
+
+// Destino del resultado de la instrucción i (ver evaluator_block)
+static double *evaluator_dest(Evaluator *ev, uint32_t i,
+                              const EvaluatorOperand *level, double *out)
+{
+    if (i + 1 == ev->count) {
+        return out;
+    } else if (ev->code[i + 1].op == EVALUATOR_STORE) {
+        return ev->blocks + (size_t) (ev->depth + 1 + ev->code[i + 1].slot -
+                                      ev->shared_slot) * COLUMN_BLOCK_SIZE;
+    }
+
+    return ev->blocks + (size_t) (level - ev->operands) * COLUMN_BLOCK_SIZE;
+}
+
+static uint32_t evaluator_jump(Evaluator *ev, uint32_t level, uint32_t i,
+                               size_t n, EvaluatorOperand *top, double *out);
+
+/*
+ * Evalúa code[from, to) sobre n filas del nivel level a partir de la cima
+ * top y devuelve la nueva cima. El operando del nivel d de la pila, si no es
+ * una columna o un escalar, vive en el bloque d; la última instrucción
+ * escribe directamente en out, y la que va antes de un EVALUATOR_STORE, en el
+ * bloque del resultado compartido. Las operaciones entre escalares se
+ * resuelven una vez por bloque.
+ */
+static EvaluatorOperand *evaluator_range(Evaluator *ev, uint32_t level,
+                                         uint32_t from, uint32_t to, size_t n,
+                                         EvaluatorOperand *top, double *out)
+{
+    const EvaluatorInstruction *code = ev->code;
+    for (uint32_t i = from; i < to; i++) {
+        unsigned op = code[i].op;
+        uint32_t slot = code[i].slot;
+        if (op == OPERATOR_NONE && slot < ev->number_count) {
+            top++;
+            top->values = NULL;
+            top->scalar = ev->slots[slot];
+            continue;
+        } else if (op == OPERATOR_NONE) {
+            *++top = *evaluator_var(ev, level, slot - ev->number_count);
+            continue;
+        } else if (op == EVALUATOR_STORE) {
+            ev->selections[0].vars[slot - ev->number_count] = *top;
+            continue;
+        } else if (op == EVALUATOR_JUMP_FALSE || op == EVALUATOR_JUMP_TRUE) {
+            uint32_t next = evaluator_jump(ev, level, i, n, top, out);
+            if (next == i + 1) {
+                top--;
+            }
+
+            i = next - 1;
+            continue;
+        }
+
+        EvaluatorOperand *a = top - 1;
+        EvaluatorOperand *b = top;
+        if (op == EVALUATOR_TRUTH) {
+            // b != 0 como b | 0
+            op = OPERATOR_OR;
+            a = top;
+            b = &ev->operands[ev->depth];
+            b->values = NULL;
+            b->scalar = 0;
+        } else {
+            top--;
+        }
+
+        if (a->values == NULL && b->values == NULL) {
+            a->scalar = evaluator_apply(op, a->scalar, b->scalar);
+            continue;
+        }
+
+        double *dest = evaluator_dest(ev, i, a, out);
+        ColumnShape shape = a->values == NULL ? COLUMN_SV :
+                            b->values == NULL ? COLUMN_VS : COLUMN_VV;
+        ev->kernels->ops[shape][op](dest,
+                                    a->values != NULL ? a->values : &a->scalar,
+                                    b->values != NULL ? b->values : &b->scalar,
+                                    n);
+        a->values = dest;
+    }
+
+    return top;
+}
+
+/*
+ * Cortocircuito de la instrucción i con el operando izquierdo en top.
+ * Devuelve la siguiente instrucción: i + 1 si el operando derecho debe
+ * evaluarse entero (y top se desapila) o el destino del salto si el
+ * resultado ya está en top. Si solo quedan algunas filas sin decidir, el
+ * operando derecho se evalúa en el nivel siguiente, encima de top, y se
+ * combina con él.
+ */
+static uint32_t evaluator_jump(Evaluator *ev, uint32_t level, uint32_t i,
+                               size_t n, EvaluatorOperand *top, double *out)
+{
+    int is_or = ev->code[i].op == EVALUATOR_JUMP_TRUE;
+    uint32_t target = ev->code[i].slot;
+    if (top->values == NULL) {
+        if ((top->scalar != 0) != is_or) {
+            return i + 1;
+        }
+
+        top->scalar = is_or;
+        return target;
+    }
+
+    EvaluatorSelection *s = &ev->selections[level + 1];
+    const double *a = top->values;
+    size_t k = 0;
+    for (size_t r = 0; r < n; r++) {
+        s->rows[k] = (uint32_t) r;
+        k += (a[r] != 0) != is_or;
+    }
+
+    if (k == n) {
+        return i + 1;
+    } else if (k == 0) {
+        top->values = NULL;
+        top->scalar = is_or;
+        return target;
+    }
+
+    s->row_count = k;
+    s->compact = k * EVALUATOR_COMPACT_RATIO <= n;
+    memset(s->gathered, 0, ev->slot_count - ev->number_count);
+    const EvaluatorOperand *b = evaluator_range(ev, level + 1, i + 1,
+                                                target - 1, s->compact ? k : n,
+                                                top, NULL);
+
+    // En las filas sin decidir a & b (o a | b) vale lo que b != 0, y en las
+    // demás, lo que a != 0, así que basta con aplicar el operador. Al
+    // compactar, b se reparte antes sobre a != 0.
+    double *dest = evaluator_dest(ev, target - 1, top, out);
+    const ColumnKernel *ops = ev->kernels->ops[COLUMN_VS];
+    EvaluatorOperand *zero = &ev->operands[ev->depth];
+    zero->values = NULL;
+    zero->scalar = 0;
+    if (b->values == NULL) {
+        ops[is_or ? OPERATOR_OR : OPERATOR_AND](dest, a, &b->scalar, n);
+    } else if (!s->compact) {
+        ev->kernels->ops[COLUMN_VV][is_or ? OPERATOR_OR : OPERATOR_AND](
+            dest, a, b->values, n);
+    } else {
+        ops[OPERATOR_OR](dest, a, &zero->scalar, n);
+        for (size_t m = 0; m < k; m++) {
+            dest[s->rows[m]] = b->values[m];
+        }
+
+        ops[OPERATOR_OR](dest, dest, &zero->scalar, n);
+    }
+
+    top->values = dest;
+    return target;
+}
+
+// Evalúa las filas [start, start + n) en out (n <= COLUMN_BLOCK_SIZE)
+static void evaluator_block(Evaluator *ev, const double *const *columns,
+                            size_t start, size_t n, double *out)
+{
+    EvaluatorOperand *vars = ev->selections[0].vars;
+    for (uint32_t j = 0; j + ev->number_count < ev->shared_slot; j++) {
+        vars[j].values = columns[j] != NULL ? columns[j] + start : NULL;
+        vars[j].scalar = ev->slots[ev->number_count + j];
+    }
+
+    EvaluatorOperand *top = evaluator_range(ev, 0, 0, ev->count, n,
+                                            ev->operands - 1, out);
+    if (top->values == NULL) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = top->scalar;
+        }
+    } else if (top->values != out) {
+        memcpy(out, top->values, n * sizeof(*out));
+    }
+}
+
+/*
+ * Evalúa rows filas. columns tiene una entrada por identificador, en el orden
+ * de la tabla de nombres del Rpn; si una es NULL, el identificador vale lo
+ * mismo en todas las filas (el valor dado con evaluator_bind).
+ */
+void evaluator_run_columns(Evaluator *ev, const double *const *columns,
+                           size_t rows, double *result)
+{
+    evaluator_reserve_blocks(ev);
+    for (size_t start = 0; start < rows; start += COLUMN_BLOCK_SIZE) {
+        size_t n = rows - start < COLUMN_BLOCK_SIZE ? rows - start
+                                                     : COLUMN_BLOCK_SIZE;
+        evaluator_block(ev, columns, start, n, result + start);
+    }
+}
+
+// Como evaluator_run_columns, pero deja un bit por fila en selection (a 1 si
+// el valor es distinto de 0) y devuelve cuántas filas se seleccionan
+size_t evaluator_select(Evaluator *ev, const double *const *columns,
+                        size_t rows, uint64_t *selection)
+{
+    evaluator_reserve_blocks(ev);
+    double *out = ev->blocks + (size_t) ev->depth * COLUMN_BLOCK_SIZE;
+    size_t count = 0;
+    for (size_t start = 0; start < rows; start += COLUMN_BLOCK_SIZE) {
+        size_t n = rows - start < COLUMN_BLOCK_SIZE ? rows - start
+                                                     : COLUMN_BLOCK_SIZE;
+        evaluator_block(ev, columns, start, n, out);
+        count += ev->kernels->select(out, n, selection + start / 64);
+    }
+
+    return count;
+}
@@ -0,0 +1,190 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "column.h"
+#include "dag.h"
+#include "rpn.h"
+
+// Evaluaciones tras las que evaluator_run compila la expresión (jit.h)
+#ifndef EVALUATOR_JIT_AFTER
+#define EVALUATOR_JIT_AFTER 1000
+#endif
+
+// En el modo por columnas, el operando derecho de un cortocircuito se evalúa
+// solo sobre las filas sin decidir, copiadas aparte, si son como mucho una de
+// cada EVALUATOR_COMPACT_RATIO; si son más, sobre el bloque entero
+#ifndef EVALUATOR_COMPACT_RATIO
+#define EVALUATOR_COMPACT_RATIO 2
+#endif
+
+typedef struct Jit Jit;
+
+// Instrucción que guarda la cima de la pila en slots[slot] sin desapilarla
+#define EVALUATOR_STORE COLUMN_OPERATOR_COUNT
+
+// Cortocircuito de "&": si la cima vale 0 la deja en 0.0 y salta a la
+// instrucción slot; si no, la desapila. EVALUATOR_JUMP_TRUE hace lo mismo
+// para "|" cuando la cima es distinta de 0, dejándola en 1.0.
+#define EVALUATOR_JUMP_FALSE (COLUMN_OPERATOR_COUNT + 1)
+#define EVALUATOR_JUMP_TRUE (COLUMN_OPERATOR_COUNT + 2)
+
+// Cierra el cortocircuito sin salto: la cima pasa a valer 1.0 o 0.0
+#define EVALUATOR_TRUTH (COLUMN_OPERATOR_COUNT + 3)
+
+typedef struct {
+    uint8_t op;             // TokenOperator; OPERATOR_NONE apila slots[slot]
+    uint32_t slot;
+} EvaluatorInstruction;
+
+// Operando del modo por columnas: un bloque de valores o, si values es NULL,
+// un escalar
+typedef struct {
+    const double *values;
+    double scalar;
+} EvaluatorOperand;
+
+// Código de un nivel de la pila durante la carga: dónde empieza y cuántos
+// EVALUATOR_STORE había antes
+typedef struct {
+    uint32_t start;
+    uint32_t stores;
+} EvaluatorSpan;
+
+/*
+ * Filas de un nivel de anidamiento de los cortocircuitos en el modo por
+ * columnas. vars tiene un operando por identificador y resultado compartido
+ * (el del hueco number_count + j). En el nivel 0 son las columnas del bloque;
+ * en los demás, solo las filas que siguen sin decidir (rows), copiadas del
+ * nivel anterior la primera vez que se cargan si compact es verdadero.
+ */
+typedef struct {
+    EvaluatorOperand *vars;
+    uint8_t *gathered;
+    double *blocks;         // Uno por operando de vars, al compactar
+    uint32_t var_capacity;
+    uint32_t *rows;
+    size_t row_count;
+    int compact;
+} EvaluatorSelection;
+
+/*
+ * Evaluador de una expresión en postfija. evaluator_load copia el programa y
+ * prepara una tabla de huecos con las constantes seguidas de un hueco por
+ * identificador; evaluator_bind da valor a estos últimos. evaluator_run no
+ * reserva memoria: la pila tiene desde la carga la profundidad máxima que
+ * alcanza el programa.
+ *
+ * Los operadores relacionales y lógicos dan 1.0 (verdadero) o 0.0 (falso);
+ * "&" y "|" consideran verdadero todo valor distinto de 0.
+ *
+ * En el modo por columnas (evaluator_run_columns, evaluator_select) cada
+ * identificador recibe una columna de valores y la expresión se evalúa por
+ * bloques de COLUMN_BLOCK_SIZE filas: cada instrucción recorre el bloque
+ * entero con un núcleo SIMD, de modo que el coste de interpretarla se reparte
+ * entre todas sus filas. Los resultados intermedios ocupan un bloque por
+ * nivel de la pila; se reservan la primera vez que hacen falta.
+ *
+ * Las subexpresiones repetidas se calculan una sola vez: evaluator_load
+ * construye el grafo de la expresión (dag.h) y cada operador con más de un
+ * padre se guarda con EVALUATOR_STORE en un hueco tras los identificadores,
+ * que las demás apariciones cargan como si fuera uno más. En el modo por
+ * columnas el hueco es un bloque propio.
+ *
+ * "&" y "|" se evalúan en cortocircuito: su operando derecho solo se calcula
+ * si el izquierdo no decide el resultado. En el modo por columnas se calcula
+ * únicamente sobre las filas sin decidir, compactadas si son pocas. Un
+ * operando derecho que guarda un resultado compartido se calcula siempre.
+ *
+ * evaluator_run interpreta las primeras jit_after evaluaciones de cada
+ * expresión y después la traduce a código máquina si puede (x86-64, pila de
+ * hasta JIT_MAX_DEPTH niveles). jit_after = 0 lo desactiva.
+ */
+typedef struct {
+    EvaluatorInstruction *code;
+    uint32_t count;
+    size_t capacity;
+    double *slots;
+    uint32_t slot_count;
+    size_t slot_capacity;
+    uint32_t number_count;  // Los identificadores empiezan en este hueco
+    uint32_t shared_slot;   // Y los resultados compartidos, en este
+    double *stack;
+    uint32_t depth;
+    size_t stack_capacity;
+    const Rpn *rpn;
+    Dag *dag;
+    uint32_t *node_slots;   // Hueco de cada nodo compartido ya calculado
+    size_t node_capacity;
+    EvaluatorSpan *spans;   // Pila de la carga
+    size_t span_capacity;
+    uint32_t *jumps;        // Cortocircuitos pendientes de la carga
+    size_t jump_capacity;
+    uint32_t jump_depth;    // Cortocircuitos anidados como máximo
+    const ColumnKernels *kernels;
+    EvaluatorOperand *operands;
+    double *blocks;
+    uint32_t block_capacity;    // Uno por nivel, el de selección y los
+                                // compartidos
+    EvaluatorSelection *selections;
+    uint32_t selection_capacity;
+    Jit *jit;
+    uint64_t runs;              // Evaluaciones interpretadas
+    uint64_t jit_after;
+} Evaluator;
+
+Evaluator *evaluator_new(void);
+void evaluator_destroy(Evaluator *ev);
+int evaluator_load(Evaluator *ev, const Rpn *rpn);
+int evaluator_bind(Evaluator *ev, const char *name, size_t length,
+                   double value);
+double evaluator_interpret(Evaluator *ev);
+double evaluator_run(Evaluator *ev);
+void evaluator_run_columns(Evaluator *ev, const double *const *columns,
+                           size_t rows, double *result);
+size_t evaluator_select(Evaluator *ev, const double *const *columns,
+                        size_t rows, uint64_t *selection);
+
+// Aplica un operador binario; la usan el intérprete, el modo por columnas con
+// dos escalares y el plegado de constantes (optimizer.h)
+static inline double evaluator_apply(TokenOperator op, double x, double y)
+{
+    switch (op) {
+    case OPERATOR_PLUS:
+        return x + y;
+    case OPERATOR_MINUS:
+        return x - y;
+    case OPERATOR_MUL:
+        return x * y;
+    case OPERATOR_DIV:
+        return x / y;
+    case OPERATOR_POW:
+        return pow(x, y);
+    case OPERATOR_EQ:
+        return x == y;
+    case OPERATOR_LT:
+        return x < y;
+    case OPERATOR_LE:
+        return x <= y;
+    case OPERATOR_GT:
+        return x > y;
+    case OPERATOR_GE:
+        return x >= y;
+    case OPERATOR_AND:
+        return (x != 0) & (y != 0);
+    case OPERATOR_OR:
+        return (x != 0) | (y != 0);
+    default:
+        return NAN;
+    }
+}
+
+// Hueco del identificador index de la tabla de nombres del Rpn cargado
+static inline double *evaluator_value(Evaluator *ev, uint32_t index)
+{
+    return &ev->slots[ev->number_count + index];
+}
+
+#endif
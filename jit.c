@@ -0,0 +1,387 @@
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include <math.h>
+#include <string.h>
+#include "cdefs.h"
+#include "cmem.h"
+
+#ifdef JIT_HAVE_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// El código empieza tras la constante 1.0, a la que se accede relativa a rip
+#define JIT_CODE_OFFSET 16
+
+// Hueco en la pila para guardar los registros vivos al llamar a pow
+#define JIT_FRAME_SIZE 128
+
+#define JIT_SCRATCH 15
+
+// Predicados de cmpsd
+#define JIT_CMP_EQ 0
+#define JIT_CMP_LT 1
+#define JIT_CMP_LE 2
+#define JIT_CMP_NEQ 4
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} JitBuffer;
+
+static void jit_byte(JitBuffer *buf, uint8_t byte)
+{
+    if (buf->size == buf->capacity) {
+        buf->capacity *= 2;
+        buf->data = crealloc(buf->data, buf->capacity);
+    }
+
+    buf->data[buf->size++] = byte;
+}
+
+static void jit_bytes(JitBuffer *buf, const void *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        jit_byte(buf, ((const uint8_t*) bytes)[i]);
+    }
+}
+
+static void jit_u32(JitBuffer *buf, uint32_t value)
+{
+    jit_bytes(buf, &value, sizeof(value));
+}
+
+// Prefijo, REX si hace falta y código de operación de una instrucción SSE2
+static void jit_sse_head(JitBuffer *buf, uint8_t prefix, uint8_t opcode,
+                         int reg, int rm)
+{
+    jit_byte(buf, prefix);
+    uint8_t rex = 0x40 | (reg >> 3) << 2 | (rm >> 3);
+    if (rex != 0x40) {
+        jit_byte(buf, rex);
+    }
+
+    jit_byte(buf, 0x0f);
+    jit_byte(buf, opcode);
+}
+
+// op xmm(reg), xmm(rm)
+static void jit_sse(JitBuffer *buf, uint8_t prefix, uint8_t opcode, int reg,
+                    int rm)
+{
+    jit_sse_head(buf, prefix, opcode, reg, rm);
+    jit_byte(buf, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// op xmm(reg), [rbx + disp]
+static void jit_sse_rbx(JitBuffer *buf, uint8_t prefix, uint8_t opcode,
+                        int reg, uint32_t disp)
+{
+    jit_sse_head(buf, prefix, opcode, reg, 0);
+    jit_byte(buf, 0x80 | (reg & 7) << 3 | 3);
+    jit_u32(buf, disp);
+}
+
+// op xmm(reg), [rsp + disp]
+static void jit_sse_rsp(JitBuffer *buf, uint8_t prefix, uint8_t opcode,
+                        int reg, uint8_t disp)
+{
+    jit_sse_head(buf, prefix, opcode, reg, 0);
+    jit_byte(buf, 0x40 | (reg & 7) << 3 | 4);
+    jit_byte(buf, 0x24);
+    jit_byte(buf, disp);
+}
+
+// op xmm(reg), [rip + ...] con destino en la posición target del búfer
+static void jit_sse_rip(JitBuffer *buf, uint8_t prefix, uint8_t opcode,
+                        int reg, size_t target)
+{
+    jit_sse_head(buf, prefix, opcode, reg, 0);
+    jit_byte(buf, 0x05 | (reg & 7) << 3);
+    jit_u32(buf, (uint32_t) (target - (buf->size + 4)));
+}
+
+#define jit_movsd_load_rbx(buf, reg, disp) \
+    jit_sse_rbx(buf, 0xf2, 0x10, reg, disp)
+#define jit_movsd_store_rbx(buf, reg, disp) \
+    jit_sse_rbx(buf, 0xf2, 0x11, reg, disp)
+#define jit_movapd(buf, dst, src) jit_sse(buf, 0x66, 0x28, dst, src)
+
+static void jit_cmpsd(JitBuffer *buf, int dst, int src, uint8_t predicate)
+{
+    jit_sse(buf, 0xf2, 0xc2, dst, src);
+    jit_byte(buf, predicate);
+}
+
+// Convierte la máscara de xmm(reg) en 1.0 o 0.0
+static void jit_bool(JitBuffer *buf, int reg)
+{
+    jit_sse_rip(buf, 0x66, 0x54, reg, 0);
+}
+
+// Salto corto hacia delante; devuelve la posición del desplazamiento
+static size_t jit_jcc8(JitBuffer *buf, uint8_t opcode)
+{
+    jit_byte(buf, opcode);
+    jit_byte(buf, 0);
+    return buf->size - 1;
+}
+
+static void jit_patch8(JitBuffer *buf, size_t at)
+{
+    buf->data[at] = (uint8_t) (buf->size - (at + 1));
+}
+
+// Salto de 32 bits hacia delante; devuelve la posición del desplazamiento
+static size_t jit_jmp32(JitBuffer *buf)
+{
+    jit_byte(buf, 0xe9);
+    jit_u32(buf, 0);
+    return buf->size - 4;
+}
+
+/*
+ * Cortocircuito sobre xmm(reg), que se compara con 0 (ucomisd da "no
+ * ordenado" con NaN, que cuenta como distinto de 0). Si el valor decide el
+ * resultado, deja en reg 1.0 para "|" o 0.0 para "&" y sigue por un jmp
+ * rel32; si no, salta por encima de él para evaluar el operando derecho.
+ * Devuelve la posición del desplazamiento de ese jmp, que jit_emit completa
+ * con el destino del cortocircuito.
+ */
+static size_t jit_jump(JitBuffer *buf, int reg, int jump_true)
+{
+    jit_sse(buf, 0x66, 0x57, JIT_SCRATCH, JIT_SCRATCH);    // xorpd
+    jit_sse(buf, 0x66, 0x2e, reg, JIT_SCRATCH);            // ucomisd
+    size_t at;
+    if (jump_true) {
+        size_t nan = jit_jcc8(buf, 0x7a);       // jp
+        size_t zero = jit_jcc8(buf, 0x74);      // je
+        jit_patch8(buf, nan);
+        jit_sse_rip(buf, 0xf2, 0x10, reg, 0);   // movsd reg, 1.0
+        at = jit_jmp32(buf);
+        jit_patch8(buf, zero);
+    } else {
+        size_t nan = jit_jcc8(buf, 0x7a);       // jp
+        size_t nonzero = jit_jcc8(buf, 0x75);   // jne
+        jit_sse(buf, 0x66, 0x57, reg, reg);     // xorpd: +0.0
+        at = jit_jmp32(buf);
+        jit_patch8(buf, nan);
+        jit_patch8(buf, nonzero);
+    }
+
+    return at;
+}
+
+// xmm(a) = pow(xmm(a), xmm(b)) con b = a + 1; los registros por debajo de a
+// se guardan en la pila porque pow puede modificarlos todos
+static void jit_pow(JitBuffer *buf, int a, int b)
+{
+    for (int i = 0; i < a; i++) {
+        jit_sse_rsp(buf, 0xf2, 0x11, i, (uint8_t) (8 * i));
+    }
+
+    if (a != 0) {
+        jit_movapd(buf, 0, a);
+        jit_movapd(buf, 1, b);
+    }
+
+    double (*func)(double, double) = pow;
+    uint64_t address = (uint64_t) (uintptr_t) func;
+    jit_byte(buf, 0x48);            // mov rax, imm64
+    jit_byte(buf, 0xb8);
+    jit_bytes(buf, &address, sizeof(address));
+    jit_byte(buf, 0xff);            // call rax
+    jit_byte(buf, 0xd0);
+
+    if (a != 0) {
+        jit_movapd(buf, a, 0);
+    }
+
+    for (int i = 0; i < a; i++) {
+        jit_sse_rsp(buf, 0xf2, 0x10, i, (uint8_t) (8 * i));
+    }
+}
+
+/*
+ * Traduce el programa del evaluador a código x86-64 (System V). El nivel d de
+ * la pila vive en xmm(d) y xmm15 sirve de auxiliar; rbx guarda el puntero a
+ * los huecos, que se leen en cada llamada para ver los valores actuales de
+ * los identificadores y donde se escriben los resultados compartidos. Los
+ * operadores lógicos y relacionales se resuelven sin saltos con cmpsd y un
+ * AND con 1.0, igual que los núcleos de column.c.
+ */
+static void jit_emit(JitBuffer *buf, const EvaluatorInstruction *code,
+                     uint32_t count)
+{
+    // Posición de cada instrucción, para completar los saltos
+    size_t *offsets = cmalloc((count + 1) * sizeof(*offsets));
+    size_t *jumps = cmalloc(count * sizeof(*jumps));
+    static const uint8_t prologue[] = {
+        0x53,                                       // push rbx
+        0x48, 0x89, 0xfb,                           // mov rbx, rdi
+        0x48, 0x81, 0xec, JIT_FRAME_SIZE, 0, 0, 0,  // sub rsp, FRAME
+    };
+    static const uint8_t epilogue[] = {
+        0x48, 0x81, 0xc4, JIT_FRAME_SIZE, 0, 0, 0,  // add rsp, FRAME
+        0x5b,                                       // pop rbx
+        0xc3,                                       // ret
+    };
+
+    double one = 1.0;
+    jit_bytes(buf, &one, sizeof(one));
+    while (buf->size < JIT_CODE_OFFSET) {
+        jit_byte(buf, 0xcc);
+    }
+
+    jit_bytes(buf, prologue, sizeof(prologue));
+    int top = -1;
+    for (uint32_t i = 0; i < count; i++) {
+        unsigned op = code[i].op;
+        offsets[i] = buf->size;
+        if (op == OPERATOR_NONE) {
+            jit_movsd_load_rbx(buf, ++top, code[i].slot * sizeof(double));
+            continue;
+        } else if (op == EVALUATOR_STORE) {
+            jit_movsd_store_rbx(buf, top, code[i].slot * sizeof(double));
+            continue;
+        } else if (op == EVALUATOR_JUMP_FALSE || op == EVALUATOR_JUMP_TRUE) {
+            jumps[i] = jit_jump(buf, top--, op == EVALUATOR_JUMP_TRUE);
+            continue;
+        } else if (op == EVALUATOR_TRUTH) {
+            jit_sse(buf, 0x66, 0x57, JIT_SCRATCH, JIT_SCRATCH);    // xorpd
+            jit_cmpsd(buf, top, JIT_SCRATCH, JIT_CMP_NEQ);
+            jit_bool(buf, top);
+            continue;
+        }
+
+        int a = top - 1;
+        int b = top--;
+        switch (op) {
+        case OPERATOR_PLUS:
+            jit_sse(buf, 0xf2, 0x58, a, b);
+            break;
+        case OPERATOR_MINUS:
+            jit_sse(buf, 0xf2, 0x5c, a, b);
+            break;
+        case OPERATOR_MUL:
+            jit_sse(buf, 0xf2, 0x59, a, b);
+            break;
+        case OPERATOR_DIV:
+            jit_sse(buf, 0xf2, 0x5e, a, b);
+            break;
+        case OPERATOR_POW:
+            jit_pow(buf, a, b);
+            break;
+        case OPERATOR_EQ:
+            jit_cmpsd(buf, a, b, JIT_CMP_EQ);
+            jit_bool(buf, a);
+            break;
+        case OPERATOR_LT:
+            jit_cmpsd(buf, a, b, JIT_CMP_LT);
+            jit_bool(buf, a);
+            break;
+        case OPERATOR_LE:
+            jit_cmpsd(buf, a, b, JIT_CMP_LE);
+            jit_bool(buf, a);
+            break;
+        case OPERATOR_GT:
+        case OPERATOR_GE:
+            // a > b es b < a: los predicados "no menor" serían ciertos con NaN
+            jit_cmpsd(buf, b, a, op == OPERATOR_GT ? JIT_CMP_LT : JIT_CMP_LE);
+            jit_movapd(buf, a, b);
+            jit_bool(buf, a);
+            break;
+        case OPERATOR_AND:
+        case OPERATOR_OR:
+            jit_sse(buf, 0x66, 0x57, JIT_SCRATCH, JIT_SCRATCH);    // xorpd
+            jit_cmpsd(buf, a, JIT_SCRATCH, JIT_CMP_NEQ);
+            jit_cmpsd(buf, b, JIT_SCRATCH, JIT_CMP_NEQ);
+            jit_sse(buf, 0x66, op == OPERATOR_AND ? 0x54 : 0x56, a, b);
+            jit_bool(buf, a);
+            break;
+        default:
+            break;
+        }
+    }
+
+    offsets[count] = buf->size;
+    jit_bytes(buf, epilogue, sizeof(epilogue));
+    for (uint32_t i = 0; i < count; i++) {
+        if (code[i].op == EVALUATOR_JUMP_FALSE ||
+            code[i].op == EVALUATOR_JUMP_TRUE)
+        {
+            uint32_t rel = (uint32_t) (offsets[code[i].slot] - (jumps[i] + 4));
+            memcpy(buf->data + jumps[i], &rel, sizeof(rel));
+        }
+    }
+
+    cfree(offsets);
+    cfree(jumps);
+}
+
+// Devuelve NULL si el programa no cabe en los registros
+Jit *jit_compile(const EvaluatorInstruction *code, uint32_t count,
+                 uint32_t depth)
+{
+    if (depth > JIT_MAX_DEPTH) {
+        return NULL;
+    }
+
+    JitBuffer buf;
+    buf.capacity = 256;
+    buf.size = 0;
+    buf.data = cmalloc(buf.capacity);
+    jit_emit(&buf, code, count);
+
+    // La página se escribe y después pasa a ser solo de lectura y ejecución
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t size = (buf.size + page_size - 1) / page_size * page_size;
+    void *page = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        cfree(buf.data);
+        return NULL;
+    }
+
+    memcpy(page, buf.data, buf.size);
+    cfree(buf.data);
+    if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(page, size);
+        return NULL;
+    }
+
+    Jit *jit = cmalloc(sizeof(*jit));
+    jit->page = page;
+    jit->size = size;
+    jit->func = (JitFunc) (void*) ((uint8_t*) page + JIT_CODE_OFFSET);
+    return jit;
+}
+
+void jit_destroy(Jit *jit)
+{
+    munmap(jit->page, jit->size);
+    cfree(jit);
+}
+
+#else
+
+Jit *jit_compile(const EvaluatorInstruction *code, uint32_t count,
+                 uint32_t depth)
+{
+    (void) code;
+    (void) count;
+    (void) depth;
+    return NULL;
+}
+
+void jit_destroy(Jit *jit)
+{
+    (void) jit;
+}
+
+#endif
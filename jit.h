@@ -0,0 +1,29 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "evaluator.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define JIT_HAVE_X86_64
+#endif
+
+// Niveles de la pila que caben en registros xmm; el último queda libre
+#define JIT_MAX_DEPTH 15
+
+// Recibe la tabla de huecos del evaluador, donde deja los resultados
+// compartidos, y devuelve el valor
+typedef double (*JitFunc)(double *slots);
+
+struct Jit {
+    void *page;
+    size_t size;
+    JitFunc func;
+};
+
+Jit *jit_compile(const EvaluatorInstruction *code, uint32_t count,
+                 uint32_t depth);
+void jit_destroy(Jit *jit);
+
+#endif
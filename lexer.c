@@ -1,8 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "lexer.h"
-#include <ctype.h>
 #include <string.h>
 #include "cdefs.h"
 #include "cmem.h"
+#include "number.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LEXER_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define LEXER_HAVE_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
 
 typedef enum {
     BEGIN,
@@ -21,42 +33,321 @@ typedef enum {
     OR4,
     OR5,
     OL,
+    LEXER_STATE_COUNT,
 } LexerState;
 
-Lexer *lexer_new(FILE *stream)
+// Clases de caracteres del autómata
+typedef enum {
+    OT,     // Otro carácter (inválido)
+    SP,     // Espacio
+    NL,     // Salto de línea ("\r" o "\n")
+    DG,     // Dígito
+    DT,     // "."
+    AL,     // Letra o "_"
+    PA,     // "("
+    PC,     // ")"
+    AR,     // "+" | "-" | "*" | "/" | "^"
+    EQ,     // "="
+    LT,     // "<"
+    GT,     // ">"
+    LO,     // "&" | "|"
+    EF,     // Fin de archivo
+    LEXER_CLASS_COUNT,
+} LexerCharClass;
+
+// Una entrada de la tabla de transiciones codifica el siguiente estado en los
+// bits bajos y las acciones a ejecutar en los altos. Las entradas sin acciones
+// (el caso común) solo cambian de estado.
+#define LEXER_ENTRY_STATE    0x00f
+#define LEXER_ENTRY_START    0x010  // El carácter inicia un token
+#define LEXER_ENTRY_ACCEPT   0x020  // Aceptar el token (sin el carácter)
+#define LEXER_ENTRY_PUSHBACK 0x040  // Devolver el carácter a la entrada
+#define LEXER_ENTRY_ERROR    0x080  // Error léxico
+#define LEXER_ENTRY_NEWLINE  0x100  // Contar salto de línea
+#define LEXER_ENTRY_END      0x200  // Fin de la entrada sin token
+#define LEXER_ENTRY_RUN      0x400  // Saltar la secuencia con un núcleo de scan
+#define LEXER_ENTRY_BREAK    0x800  // Fin de expresión (modo por líneas)
+#define LEXER_ENTRY_ACTIONS  0xff0
+
+#define S   LEXER_ENTRY_START
+#define N   LEXER_ENTRY_NEWLINE
+#define F   LEXER_ENTRY_END
+#define A   LEXER_ENTRY_ACCEPT
+#define AP  (LEXER_ENTRY_ACCEPT | LEXER_ENTRY_PUSHBACK)
+#define AN  (LEXER_ENTRY_ACCEPT | LEXER_ENTRY_NEWLINE)
+#define E   LEXER_ENTRY_ERROR
+#define EP  (LEXER_ENTRY_ERROR | LEXER_ENTRY_PUSHBACK)
+#define R   LEXER_ENTRY_RUN
+#define B   LEXER_ENTRY_BREAK
+
+// Estado que acepta el token con cualquier carácter siguiente
+#define ACCEPT_ALL(NA) { AP, A, NA, AP, AP, AP, AP, AP, AP, AP, AP, AP, AP, A }
+
+static const unsigned char lexer_char_classes[256] = {
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, SP, NL, SP, SP, NL, OT, OT,
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+    SP, OT, OT, OT, OT, OT, LO, OT, PA, PC, AR, AR, OT, AR, DT, AR,
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, OT, OT, LT, EQ, GT, OT,
+    OT, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OT, OT, OT, AR, AL,
+    OT, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OT, LO, OT, OT, OT,
+};
+
+// La columna NL cambia según el modo: NB en BEGIN, NA en los estados que
+// aceptan y NE en NUM4. En el modo por líneas el salto de línea se devuelve a
+// la entrada para que BEGIN emita EXPRESSION_END.
+#define LEXER_TRANSITIONS(NB, NA, NE) { \
+    /*          OT    SP       NL  DG      DT      AL    PA    PC    AR    EQ     LT     GT     LO    EF */ \
+    [BEGIN] = { S|E,  BEGIN|R, NB, S|NUM1, S|NUM4, S|ID, S|PL, S|PR, S|OA, S|OR1, S|OR2, S|OR4, S|OL, F }, \
+    [NUM1]  = { AP,   A,       NA, NUM1|R, NUM2,   AP,   AP,   AP,   AP,   AP,    AP,    AP,    AP,   A }, \
+    [NUM2]  = { AP,   A,       NA, NUM3,   AP,     AP,   AP,   AP,   AP,   AP,    AP,    AP,    AP,   A }, \
+    [NUM3]  = { AP,   A,       NA, NUM3|R, AP,     AP,   AP,   AP,   AP,   AP,    AP,    AP,    AP,   A }, \
+    [NUM4]  = { EP,   E,       NE, NUM5,   EP,     EP,   EP,   EP,   EP,   EP,    EP,    EP,    EP,   E }, \
+    [NUM5]  = { AP,   A,       NA, NUM5|R, AP,     AP,   AP,   AP,   AP,   AP,    AP,    AP,    AP,   A }, \
+    [ID]    = { AP,   A,       NA, ID|R,   AP,     ID|R, AP,   AP,   AP,   AP,    AP,    AP,    AP,   A }, \
+    [PL]    = ACCEPT_ALL(NA), \
+    [PR]    = ACCEPT_ALL(NA), \
+    [OA]    = ACCEPT_ALL(NA), \
+    [OR1]   = ACCEPT_ALL(NA), \
+    [OR2]   = { AP,   A,       NA, AP,     AP,     AP,   AP,   AP,   AP,   OR3,   AP,    AP,    AP,   A }, \
+    [OR3]   = ACCEPT_ALL(NA), \
+    [OR4]   = { AP,   A,       NA, AP,     AP,     AP,   AP,   AP,   AP,   OR5,   AP,    AP,    AP,   A }, \
+    [OR5]   = ACCEPT_ALL(NA), \
+    [OL]    = ACCEPT_ALL(NA), \
+}
+
+static const unsigned short
+lexer_transitions[LEXER_STATE_COUNT][LEXER_CLASS_COUNT] =
+    LEXER_TRANSITIONS(BEGIN|N, AN, E);
+
+static const unsigned short
+lexer_transitions_lines[LEXER_STATE_COUNT][LEXER_CLASS_COUNT] =
+    LEXER_TRANSITIONS(BEGIN|N|B, AP, EP);
+
+#undef S
+#undef N
+#undef F
+#undef A
+#undef AP
+#undef AN
+#undef E
+#undef EP
+#undef R
+#undef B
+#undef ACCEPT_ALL
+#undef LEXER_TRANSITIONS
+
+// Tipo de token aceptado en cada estado
+static const TokenType lexer_state_types[LEXER_STATE_COUNT] = {
+    [NUM1] = NUMBER,
+    [NUM2] = NUMBER,
+    [NUM3] = NUMBER,
+    [NUM5] = NUMBER,
+    [ID] = IDENTIFIER,
+    [PL] = PAREN_LEFT,
+    [PR] = PAREN_RIGHT,
+    [OA] = OPERATOR_ARITHMETIC,
+    [OR1] = OPERATOR_RELATIONAL,
+    [OR2] = OPERATOR_RELATIONAL,
+    [OR3] = OPERATOR_RELATIONAL,
+    [OR4] = OPERATOR_RELATIONAL,
+    [OR5] = OPERATOR_RELATIONAL,
+    [OL] = OPERATOR_LOGICAL,
+};
+
+// Operador de los estados que lo determinan por sí solos; en OA y OL depende
+// del carácter
+static const TokenOperator lexer_state_operators[LEXER_STATE_COUNT] = {
+    [OR1] = OPERATOR_EQ,
+    [OR2] = OPERATOR_LT,
+    [OR3] = OPERATOR_LE,
+    [OR4] = OPERATOR_GT,
+    [OR5] = OPERATOR_GE,
+};
+
+static const TokenOperator lexer_char_operators[256] = {
+    ['+'] = OPERATOR_PLUS,
+    ['-'] = OPERATOR_MINUS,
+    ['*'] = OPERATOR_MUL,
+    ['/'] = OPERATOR_DIV,
+    ['^'] = OPERATOR_POW,
+    ['&'] = OPERATOR_AND,
+    ['|'] = OPERATOR_OR,
+};
+
+#ifdef LEXER_HAVE_THREADS
+static void lexer_pipe_stop(Lexer *lex);
+#endif
+
+static void lexer_init(Lexer *lex, FILE *stream, LexerBuffer *block,
+                       size_t arena_size)
 {
-    Lexer *lex = cmalloc(sizeof(*lex));
     lex->stream = stream;
-    lex->block = lexer_buffer_new(LEXER_BLOCK_SIZE);
-    lex->block->bptr = lex->block->bend;
-    lex->tbuf = lexer_buffer_new(LEXER_TBUF_SIZE);
+    lex->block = block;
+    lex->arena = carena_new(arena_size);
+    lex->scan = scan_kernels();
+    lex->index = NULL;
+    lex->pipe = NULL;
     lex->error = NULL;
+    lex->mapped = FALSE;
+    lex->borrowed = FALSE;
+    lex->lines = FALSE;
     lex->eof = FALSE;
+    lex->offset = 0;
+    lex->line_start = 0;
+    lex->cr_end = (size_t) -1;
     lex->line = 0;
     lex->column = 0;
+}
+
+Lexer *lexer_new(FILE *stream)
+{
+    Lexer *lex = cmalloc(sizeof(*lex));
+    lexer_init(lex, stream, lexer_buffer_new(LEXER_BLOCK_SIZE),
+               LEXER_ARENA_SIZE);
+    lex->block->bend = lex->block->data;
+    lex->block->bptr = lex->block->bend;
     return lex;
 }
 
+// Proyecta el archivo completo en memoria; si no es un archivo regular (p. ej.
+// una tubería) se usa la lectura por bloques de lexer_new
+Lexer *lexer_new_mmap(FILE *stream)
+{
+#ifdef LEXER_HAVE_MMAP
+    struct stat st;
+    int fd = fileno(stream);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size <= 0)
+    {
+        return lexer_new(stream);
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return lexer_new(stream);
+    }
+
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+    LexerBuffer *block = cmalloc(sizeof(*block));
+    block->size = st.st_size;
+    block->data = data;
+    block->bend = block->data + st.st_size;
+    block->bptr = block->data;
+
+    Lexer *lex = cmalloc(sizeof(*lex));
+    lexer_init(lex, stream, block, LEXER_ARENA_SIZE);
+    lex->mapped = TRUE;
+    return lex;
+#else
+    return lexer_new(stream);
+#endif
+}
+
+// Analiza un texto que ya está en memoria, sin copiarlo. El texto debe seguir
+// vivo mientras se usen el lexer y sus tokens; no se usa ningún FILE.
+Lexer *lexer_new_buffer(const char *data, size_t size)
+{
+    LexerBuffer *block = cmalloc(sizeof(*block));
+    block->size = size;
+    block->data = (char*) data;
+    block->bend = block->data + size;
+    block->bptr = block->data;
+
+    // Las expresiones cortas no necesitan un bloque de arena completo: como
+    // mucho hay un token por carácter
+    size_t arena_size = (size + 1) * sizeof(Token);
+    if (arena_size > LEXER_ARENA_SIZE) {
+        arena_size = LEXER_ARENA_SIZE;
+    }
+
+    Lexer *lex = cmalloc(sizeof(*lex));
+    lexer_init(lex, NULL, block, arena_size);
+    lex->mapped = TRUE;
+    lex->borrowed = TRUE;
+    return lex;
+}
+
+// Indica que la entrada es un fragmento de otra mayor que empieza en offset,
+// al inicio de la línea line. Las posiciones, líneas y columnas de los tokens
+// y errores se dan entonces respecto a la entrada completa.
+void lexer_set_origin(Lexer *lex, size_t offset, int line)
+{
+    lex->offset = offset;
+    lex->line_start = offset;
+    lex->line = line;
+}
+
 void lexer_destroy(Lexer *lex) {
-    lexer_buffer_destroy(lex->block);
-    lexer_buffer_destroy(lex->tbuf);
+#ifdef LEXER_HAVE_THREADS
+    if (lex->pipe != NULL) {
+        lexer_pipe_stop(lex);
+    }
+#endif
+
+    if (lex->borrowed) {
+        cfree(lex->block);
+#ifdef LEXER_HAVE_MMAP
+    } else if (lex->mapped) {
+        munmap(lex->block->data, lex->block->size);
+        cfree(lex->block);
+#endif
+    } else {
+        lexer_buffer_destroy(lex->block);
+    }
+    carena_destroy(lex->arena);
+
+    if (lex->index != NULL) {
+        if (lex->index->error != NULL) {
+            lexer_error_destroy(lex->index->error);
+        }
+
+        cfree(lex->index->tokens);
+        cfree(lex->index);
+    }
 
     if (lex->error != NULL) {
         lexer_error_destroy(lex->error);
     }
 
-    fclose(lex->stream);
+    if (lex->stream != NULL) {
+        fclose(lex->stream);
+    }
+
     cfree(lex);
 }
 
-static int lexer_block_end(Lexer *lex)
+// Lee el siguiente bloque de la entrada. Si hay un token en curso, su texto se
+// conserva al inicio del bloque (ampliándolo si hace falta) y *tstart se
+// actualiza para apuntar a él.
+static void lexer_read(Lexer *lex, const char **tstart)
 {
-    return lexer_buffer_is_end(lex->block);
-}
+    // La proyección contiene todo el archivo: no hay más bloques que leer
+    if (lex->mapped) {
+        lex->eof = TRUE;
+        return;
+    }
 
-static size_t lexer_read(Lexer *lex)
-{
-    size_t nread = fread(lex->block->data, 1, LEXER_BLOCK_SIZE, lex->stream);
+    LexerBuffer *block = lex->block;
+    size_t keep = 0;
+    if (tstart != NULL) {
+        size_t skip = *tstart - block->data;
+        keep = block->bend - *tstart;
+        lex->offset += skip;
+        memmove(block->data, block->data + skip, keep);
+        if (keep == block->size) {
+            block->size *= 2;
+            block->data = crealloc(block->data, block->size);
+        }
+
+        *tstart = block->data;
+    } else {
+        lex->offset += block->bend - block->data;
+    }
+
+    size_t nread = fread(block->data + keep, 1, block->size - keep,
+                         lex->stream);
     if (nread == 0) {
         if (feof(lex->stream)) {
             lex->eof = TRUE;
@@ -66,251 +357,568 @@ static size_t lexer_read(Lexer *lex)
         }
     }
 
-    if (!lex->eof) {
-        lex->block->bptr = lex->block->data;
-        lex->block->bend = lex->block->data + nread;
+    block->bptr = block->data + keep;
+    block->bend = block->bptr + nread;
+}
+
+static int lexer_column(Lexer *lex, const char *ptr)
+{
+    return lex->offset + (ptr - lex->block->data) - lex->line_start;
+}
+
+// "\r\n" cuenta como un único salto de línea
+static void lexer_newline(Lexer *lex, const char *ptr)
+{
+    size_t offset = lex->offset + (ptr - lex->block->data);
+    if (*ptr == '\r') {
+        lex->line++;
+        lex->cr_end = offset + 1;
+    } else if (offset != lex->cr_end) {
+        lex->line++;
     }
 
-    return nread;
+    lex->line_start = offset + 1;
 }
 
-Token *lexer_next_token(Lexer *lex)
+// Reconoce el siguiente token. Un error léxico se deja en *error.
+static int lexer_scan(Lexer *lex, Token *t, LexerError **error)
 {
-    LexerState state = BEGIN;
-    TokenType type = UNKNOWN;
-    char c;
-    int s;
-    int use_char;
-    int line;
-    int column;
-    LexerErrorType error = LEXER_ERROR_NO_ERROR;
-    lexer_buffer_seek(lex->tbuf, 0, LEXER_BUFFER_SET);
+    LexerBuffer *block = lex->block;
+    const char *bptr = block->bptr;
+    const char *bend = block->bend;
+    const char *cptr;
+    const char *tstart = NULL;
+    const char *tend;
+    size_t offset = 0;
+    unsigned state = BEGIN;
+    unsigned cls;
+    unsigned entry;
+    int line = 0;
+    int column = 0;
+    const unsigned short (*transitions)[LEXER_CLASS_COUNT] =
+        lex->lines ? lexer_transitions_lines : lexer_transitions;
 
     while (TRUE) {
-        if (lexer_block_end(lex)) {
-            lexer_read(lex);
+        if (bptr == bend && !lex->eof) {
+            block->bptr = (char*) bptr;
+            lexer_read(lex, state != BEGIN ? &tstart : NULL);
+            bptr = block->bptr;
+            bend = block->bend;
         }
 
-        if (!lex->eof) {
-            c = lexer_buffer_advance(lex->block);
-            s = isspace(c);
+        if (bptr != bend) {
+            cls = lexer_char_classes[(unsigned char) *bptr++];
         } else {
-            s = TRUE;
+            cls = EF;
         }
 
-        use_char = TRUE;
-        switch (state) {
-        case BEGIN:
-            if (lex->eof) {
-                return NULL;
-            } else if (s) {
-                break;
-            }
+        entry = transitions[state][cls];
+        if ((entry & LEXER_ENTRY_ACTIONS) == 0) {
+            state = entry;
+            continue;
+        }
 
-            if (isdigit(c)) {
-                state = NUM1;
-            } else if (c == '.') {
-                state = NUM4;
-            } else if (isalpha(c) || c == '_') {
-                state = ID;
-            } else if (c == '(') {
-                state = PL;
-            } else if (c == ')') {
-                state = PR;
-            } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') {
-                state = OA;
-            } else if (c == '=') {
-                state = OR1;
-            } else if (c == '<') {
-                state = OR2;
-            } else if (c == '>') {
-                state = OR4;
-            } else if (c == '&' || c == '|') {
-                state = OL;
+        // El resto de una secuencia de espacios, identificador o dígitos se
+        // salta en bloque. Los saltos de línea no forman parte de ninguna
+        // secuencia, así que siempre pasan por la tabla.
+        if (entry & LEXER_ENTRY_RUN) {
+            if (state == BEGIN) {
+                bptr = lex->scan->space(bptr, bend);
+            } else if (state == ID) {
+                bptr = lex->scan->word(bptr, bend);
             } else {
-                error = LEXER_ERROR_INVALID_TOKEN;
-                break;
+                bptr = lex->scan->digits(bptr, bend);
             }
 
+            continue;
+        }
+
+        // Carácter que provocó la acción (o el fin de la entrada)
+        cptr = cls == EF ? bptr : bptr - 1;
+        if (entry & LEXER_ENTRY_BREAK) {
+            // El token de fin de expresión no tiene texto
+            t->type = EXPRESSION_END;
+            t->op = OPERATOR_NONE;
+            t->text = cptr;
+            t->length = 0;
+            t->offset = lex->offset + (cptr - block->data);
+            t->line = lex->line;
+            t->column = lexer_column(lex, cptr);
+            lexer_newline(lex, cptr);
+            block->bptr = (char*) bptr;
+            lex->column = lexer_column(lex, bptr);
+            return TRUE;
+        }
+
+        if (entry & LEXER_ENTRY_NEWLINE) {
+            lexer_newline(lex, cptr);
+        }
+
+        if (entry & LEXER_ENTRY_START) {
+            tstart = cptr;
+            offset = lex->offset + (cptr - block->data);
             line = lex->line;
-            column = lex->column;
-            break;
-        case NUM1:
-            if (s) {
-                type = NUMBER;
-            } else if (c == '.') {
-                state = NUM2;
-            } else if (!isdigit(c)) {
-                type = NUMBER;
-                use_char = FALSE;
-            }
+            column = lexer_column(lex, cptr);
+        }
 
-            break;
-        case NUM2:
-            if (s || !isdigit(c)) {
-                type = NUMBER;
-                use_char = FALSE;
-            } else {
-                state = NUM3;
+        if (entry & (LEXER_ENTRY_ACCEPT | LEXER_ENTRY_ERROR)) {
+            tend = entry & LEXER_ENTRY_START ? bptr : cptr;
+            if (entry & LEXER_ENTRY_PUSHBACK) {
+                bptr--;
             }
 
             break;
-        case NUM3:
-            if (s || !isdigit(c)) {
-                type = NUMBER;
-                use_char = FALSE;
-            }
+        }
+
+        if (entry & LEXER_ENTRY_END) {
+            block->bptr = (char*) bptr;
+            lex->column = lexer_column(lex, bptr);
+            return FALSE;
+        }
+
+        state = entry & LEXER_ENTRY_STATE;
+    }
+
+    block->bptr = (char*) bptr;
+    const char *text = tstart;
+    size_t length = tend - tstart;
+
+    if (entry & LEXER_ENTRY_ERROR) {
+        lex->column = lexer_column(lex, cptr);
+        *error = lexer_error_new(lex,
+                                 cls == EF ? LEXER_ERROR_UNEXPECTED_EOF
+                                           : LEXER_ERROR_INVALID_TOKEN,
+                                 text, length);
+        return FALSE;
+    }
+
+    lex->column = lexer_column(lex, bptr);
+    if (!lex->mapped) {
+        // El bloque de lectura se reutiliza: el texto se copia a la arena
+        char *dest = carena_alloc(lex->arena, length);
+        memcpy(dest, text, length);
+        text = dest;
+    }
+
+    t->type = lexer_state_types[state];
+    t->op = lexer_state_operators[state];
+    if (state == OA || state == OL) {
+        t->op = lexer_char_operators[(unsigned char) *text];
+    }
 
+    t->text = text;
+    t->length = length;
+    t->offset = offset;
+    t->line = line;
+    t->column = column;
+    t->value = t->type == NUMBER ? number_parse(text, length) : 0;
+    return TRUE;
+}
+
+static size_t lexer_index_next_bit(const uint64_t *bits, size_t pos,
+                                   size_t size)
+{
+    size_t word = pos / 64;
+    uint64_t w = bits[word] & (~(uint64_t) 0 << (pos % 64));
+    while (w == 0) {
+        if (++word * 64 >= size) {
+            return size;
+        }
+
+        w = bits[word];
+    }
+
+    pos = word * 64 + __builtin_ctzll(w);
+    return pos < size ? pos : size;
+}
+
+// Motor alternativo para entradas proyectadas. La primera etapa clasifica
+// toda la entrada con los núcleos de scan y obtiene los mapas de inicios de
+// token y saltos de línea. La segunda salta directamente de un inicio al
+// siguiente, cuenta los saltos de línea intermedios y ejecuta el autómata solo
+// sobre el token, guardando el resultado en un arreglo plano. Un error léxico
+// se conserva hasta que se consumen los tokens anteriores, de modo que el
+// parser lo observa en el mismo punto que con lexer_next_token. El modo por
+// líneas necesita seguir tras cada error, así que no usa el índice.
+int lexer_build_index(Lexer *lex)
+{
+    if (!lex->mapped || lex->lines || lex->index != NULL ||
+        lex->pipe != NULL)
+    {
+        return FALSE;
+    }
+
+    LexerBuffer *block = lex->block;
+    const char *data = block->bptr;
+    size_t size = block->bend - block->bptr;
+    size_t words = size / 64 + 1;
+    uint64_t *starts = cmalloc(words * sizeof(*starts));
+    uint64_t *newlines = cmalloc(words * sizeof(*newlines));
+    lex->scan->index(data, size, starts, newlines);
+
+    LexerIndex *index = cmalloc(sizeof(*index));
+    index->capacity = size / 16 + 16;
+    index->tokens = cmalloc(index->capacity * sizeof(*index->tokens));
+    index->count = 0;
+    index->next = 0;
+    index->error = NULL;
+
+    size_t pos = 0;
+    while (TRUE) {
+        // Tras un carácter devuelto a la entrada (p. ej. "1.2.3") el
+        // siguiente token empieza justo ahí aunque el mapa no lo marque
+        size_t start = pos;
+        if (start == size ||
+            lexer_char_classes[(unsigned char) data[start]] == SP ||
+            lexer_char_classes[(unsigned char) data[start]] == NL)
+        {
+            start = lexer_index_next_bit(starts, pos, size);
+        }
+
+        size_t nl = lexer_index_next_bit(newlines, pos, start);
+        while (nl < start) {
+            lexer_newline(lex, data + nl);
+            nl = lexer_index_next_bit(newlines, nl + 1, start);
+        }
+
+        if (index->count == index->capacity) {
+            index->capacity *= 2;
+            index->tokens = crealloc(index->tokens,
+                                     index->capacity * sizeof(*index->tokens));
+        }
+
+        block->bptr = (char*) data + start;
+        if (!lexer_scan(lex, &index->tokens[index->count], &index->error)) {
             break;
-        case NUM4:
-            if (s || !isdigit(c)) {
-                use_char = FALSE;
-                if (lex->eof) {
-                    error = LEXER_ERROR_UNEXPECTED_EOF;
-                } else {
-                    error = LEXER_ERROR_INVALID_TOKEN;
+        }
+
+        index->count++;
+        pos = block->bptr - data;
+    }
+
+    lex->index = index;
+    cfree(starts);
+    cfree(newlines);
+    return TRUE;
+}
+
+static Token *lexer_index_next(Lexer *lex)
+{
+    LexerIndex *index = lex->index;
+    if (index->next < index->count) {
+        return &index->tokens[index->next++];
+    }
+
+    if (index->error != NULL) {
+        lex->error = index->error;
+        index->error = NULL;
+    }
+
+    return NULL;
+}
+
+#ifdef LEXER_HAVE_THREADS
+
+// Motor en dos hilos: un productor ejecuta el autómata y deja los tokens, por
+// valor, en un anillo de un solo productor y un solo consumidor; el parser los
+// toma con lexer_next_token. Cada hilo publica su posición cada
+// LEXER_PIPE_BATCH tokens o cuando tiene que esperar, de modo que los índices
+// compartidos se tocan pocas veces. Los errores léxicos viajan por el anillo
+// en su posición, así que el parser los observa en el mismo punto que con
+// lexer_next_token.
+typedef struct {
+    Token token;
+    LexerError *error;      // Error léxico en lugar de token
+    int end;                // Fin de la entrada
+} LexerPipeSlot;
+
+struct LexerPipe {
+    LexerPipeSlot *ring;
+    pthread_t thread;
+    _Alignas(64) atomic_size_t head;        // Publicado por el productor
+    _Alignas(64) atomic_size_t tail;        // Publicado por el consumidor
+    atomic_int stop;
+    _Alignas(64) size_t next;               // Siguiente hueco a leer
+    size_t head_seen;                       // Último head leído
+    int holding;                            // El parser usa el hueco next
+};
+
+static void *lexer_pipe_main(void *data)
+{
+    Lexer *lex = data;
+    LexerPipe *pipe = lex->pipe;
+    size_t head = 0;
+    size_t tail = 0;
+    int finished = FALSE;
+
+    while (TRUE) {
+        if (head - tail == LEXER_PIPE_SIZE) {
+            atomic_store_explicit(&pipe->head, head, memory_order_release);
+            while ((tail = atomic_load_explicit(&pipe->tail,
+                                                memory_order_acquire))
+                   + LEXER_PIPE_SIZE == head)
+            {
+                if (atomic_load_explicit(&pipe->stop, memory_order_relaxed)) {
+                    return NULL;
                 }
-            } else {
-                state = NUM5;
-            }
 
-            break;
-        case NUM5:
-            if (s || !isdigit(c)) {
-                type = NUMBER;
-                use_char = FALSE;
+                sched_yield();
             }
+        }
 
-            break;
-        case ID:
-            if (s || (!isalnum(c) && c != '_')) {
-                type = IDENTIFIER;
-                use_char = FALSE;
+        LexerPipeSlot *slot = &pipe->ring[head % LEXER_PIPE_SIZE];
+        slot->error = NULL;
+        slot->end = FALSE;
+        if (finished || !lexer_scan(lex, &slot->token, &slot->error)) {
+            if (slot->error == NULL) {
+                slot->end = TRUE;
+                atomic_store_explicit(&pipe->head, head + 1,
+                                      memory_order_release);
+                return NULL;
             }
 
-            break;
-        case PL:
-            type = PAREN_LEFT;
-            use_char = FALSE;
-            break;
-        case PR:
-            type = PAREN_RIGHT;
-            use_char = FALSE;
-            break;
-        case OA:
-            type = OPERATOR_ARITHMETIC;
-            use_char = FALSE;
-            break;
-        case OR1:
-            type = OPERATOR_RELATIONAL;
-            use_char = FALSE;
-            break;
-        case OR2:
-            if (s || c != '=') {
-                type = OPERATOR_RELATIONAL;
-                use_char = FALSE;
-            } else {
-                state = OR3;
-            }
+            // Fuera del modo por líneas el parser se detiene en el primer
+            // error: tras él solo queda el fin de la entrada
+            finished = !lex->lines;
+        }
 
-            break;
-        case OR3:
-            type = OPERATOR_RELATIONAL;
-            use_char = FALSE;
-            break;
-        case OR4:
-            if (s || c != '=') {
-                type = OPERATOR_RELATIONAL;
-                use_char = FALSE;
-            } else {
-                state = OR5;
+        if (++head % LEXER_PIPE_BATCH == 0) {
+            atomic_store_explicit(&pipe->head, head, memory_order_release);
+            if (atomic_load_explicit(&pipe->stop, memory_order_relaxed)) {
+                return NULL;
             }
+        }
+    }
+}
 
-            break;
-        case OR5:
-            type = OPERATOR_RELATIONAL;
-            use_char = FALSE;
-            break;
-        case OL:
-            type = OPERATOR_LOGICAL;
-            use_char = FALSE;
-            break;
+static Token *lexer_pipe_next(Lexer *lex)
+{
+    LexerPipe *pipe = lex->pipe;
+    if (pipe->holding) {
+        pipe->holding = FALSE;
+        if (++pipe->next % LEXER_PIPE_BATCH == 0) {
+            atomic_store_explicit(&pipe->tail, pipe->next,
+                                  memory_order_release);
         }
+    }
 
-        if (!s) {
-            if (use_char) {
-                lexer_buffer_put(lex->tbuf, c);
-            } else {
-                lexer_buffer_unadvance(lex->block);
-            }
+    while (pipe->next == pipe->head_seen) {
+        pipe->head_seen = atomic_load_explicit(&pipe->head,
+                                               memory_order_acquire);
+        if (pipe->next == pipe->head_seen) {
+            atomic_store_explicit(&pipe->tail, pipe->next,
+                                  memory_order_release);
+            sched_yield();
         }
+    }
 
-        if (error != LEXER_ERROR_NO_ERROR) {
-            break;
+    LexerPipeSlot *slot = &pipe->ring[pipe->next % LEXER_PIPE_SIZE];
+    if (slot->end) {
+        // El fin de la entrada no se consume: se devuelve siempre
+        return NULL;
+    } else if (slot->error != NULL) {
+        lex->error = slot->error;
+        slot->error = NULL;
+        pipe->next++;
+        return NULL;
+    }
+
+    pipe->holding = TRUE;
+    return &slot->token;
+}
+
+static void lexer_pipe_stop(Lexer *lex)
+{
+    LexerPipe *pipe = lex->pipe;
+    atomic_store_explicit(&pipe->stop, TRUE, memory_order_relaxed);
+    pthread_join(pipe->thread, NULL);
+
+    size_t head = atomic_load_explicit(&pipe->head, memory_order_acquire);
+    for (size_t i = pipe->next; i < head; i++) {
+        LexerPipeSlot *slot = &pipe->ring[i % LEXER_PIPE_SIZE];
+        if (slot->error != NULL) {
+            lexer_error_destroy(slot->error);
         }
+    }
 
-        if (!lex->eof && (s || use_char)) {
-            if (c == '\r') {
-                if (lexer_block_end(lex)) {
-                    lexer_read(lex);
-                }
+    cfree(pipe->ring);
+    cfree(pipe);
+    lex->pipe = NULL;
+}
 
-                if (!lex->eof && lexer_buffer_advance(lex->block) != '\n') {
-                    lexer_buffer_unadvance(lex->block);
-                }
-            }
-            
-            if (c == '\r' || c == '\n') {
-                lex->line++;
-                lex->column = 0;
-            } else {
-                lex->column++;
+#endif
+
+// Lanza el hilo productor del motor en dos hilos. No se combina con el índice
+// estructural y requiere soporte de hilos.
+int lexer_start_pipe(Lexer *lex)
+{
+#ifdef LEXER_HAVE_THREADS
+    if (lex->index != NULL || lex->pipe != NULL) {
+        return FALSE;
+    }
+
+    LexerPipe *pipe = cmalloc(sizeof(*pipe));
+    pipe->ring = cmalloc(LEXER_PIPE_SIZE * sizeof(*pipe->ring));
+    atomic_init(&pipe->head, 0);
+    atomic_init(&pipe->tail, 0);
+    atomic_init(&pipe->stop, FALSE);
+    pipe->next = 0;
+    pipe->head_seen = 0;
+    pipe->holding = FALSE;
+    lex->pipe = pipe;
+    if (pthread_create(&pipe->thread, NULL, lexer_pipe_main, lex) != 0) {
+        cfree(pipe->ring);
+        cfree(pipe);
+        lex->pipe = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+Token *lexer_next_token(Lexer *lex)
+{
+    Token t;
+    if (lex->index != NULL) {
+        return lexer_index_next(lex);
+    }
+
+#ifdef LEXER_HAVE_THREADS
+    if (lex->pipe != NULL) {
+        return lexer_pipe_next(lex);
+    }
+#endif
+
+    if (!lexer_scan(lex, &t, &lex->error)) {
+        return NULL;
+    }
+
+    return lexer_token_new(lex, t.type, t.op, t.text, t.length, t.offset,
+                           t.line, t.column, t.value);
+}
+
+/*
+ * Llena batch con hasta max tokens. Devuelve cuántos escribió; 0 al final de
+ * la entrada o si hay un error léxico pendiente, que pasa entonces a
+ * lex->error. En el modo por líneas el lote termina tras un EXPRESSION_END
+ * para no leer la línea siguiente antes de tiempo.
+ */
+size_t lexer_next_tokens(Lexer *lex, TokenBatch *batch, size_t max)
+{
+    size_t n = 0;
+    Token t;
+    const Token *src;
+
+    if (max > batch->capacity) {
+        max = batch->capacity;
+    }
+
+    while (batch->error == NULL && n < max) {
+        if (lex->index != NULL || lex->pipe != NULL) {
+            src = lexer_next_token(lex);
+            if (src == NULL) {
+                batch->error = lex->error;
+                lex->error = NULL;
+                break;
             }
+        } else if (lexer_scan(lex, &t, &batch->error)) {
+            src = &t;
+        } else {
+            break;
         }
 
-        if (type != UNKNOWN) {
+        batch->type[n] = (uint8_t) src->type;
+        batch->op[n] = (uint8_t) src->op;
+        batch->text[n] = src->text;
+        batch->offset[n] = src->offset;
+        batch->length[n] = src->length;
+        batch->line[n] = src->line;
+        batch->column[n] = src->column;
+        batch->value[n] = src->value;
+        n++;
+        if (src->type == EXPRESSION_END) {
             break;
         }
     }
 
-    lexer_buffer_put(lex->tbuf, 0);
-    if (error != LEXER_ERROR_NO_ERROR) {
-        lex->error = lexer_error_new(lex, error);
-        return NULL;
+    batch->count = n;
+    if (n == 0 && batch->error != NULL) {
+        lex->error = batch->error;
+        batch->error = NULL;
+    }
+
+    return n;
+}
+
+TokenBatch *token_batch_new(size_t capacity)
+{
+    TokenBatch *batch = cmalloc(sizeof(*batch));
+    batch->type = cmalloc(capacity * sizeof(*batch->type));
+    batch->op = cmalloc(capacity * sizeof(*batch->op));
+    batch->text = cmalloc(capacity * sizeof(*batch->text));
+    batch->offset = cmalloc(capacity * sizeof(*batch->offset));
+    batch->length = cmalloc(capacity * sizeof(*batch->length));
+    batch->line = cmalloc(capacity * sizeof(*batch->line));
+    batch->column = cmalloc(capacity * sizeof(*batch->column));
+    batch->value = cmalloc(capacity * sizeof(*batch->value));
+    batch->count = 0;
+    batch->capacity = capacity;
+    batch->error = NULL;
+    return batch;
+}
+
+void token_batch_destroy(TokenBatch *batch)
+{
+    if (batch->error != NULL) {
+        lexer_error_destroy(batch->error);
     }
 
-    return lexer_token_new(type, lex->tbuf->data, line, column);
+    cfree(batch->type);
+    cfree(batch->op);
+    cfree(batch->text);
+    cfree(batch->offset);
+    cfree(batch->length);
+    cfree(batch->line);
+    cfree(batch->column);
+    cfree(batch->value);
+    cfree(batch);
 }
 
-Token *lexer_token_new(TokenType type, const char *text, int line, int column)
+// Los tokens viven en la arena del lexer hasta que este se destruye. value
+// es el valor de los NUMBER, ya calculado por el lexer (number_parse).
+Token *lexer_token_new(Lexer *lex, TokenType type, TokenOperator op,
+                       const char *text, size_t length, size_t offset,
+                       int line, int column, double value)
 {
-    Token *t = cmalloc(sizeof(*t));
-    char *dest = cmalloc(strlen(text) + 1);
-    strcpy(dest, text);
+    Token *t = carena_alloc(lex->arena, sizeof(*t));
     t->type = type;
-    t->text = dest;
+    t->op = op;
+    t->text = text;
+    t->length = length;
+    t->offset = offset;
     t->line = line;
     t->column = column;
+    t->value = value;
     return t;
 }
 
-void lexer_token_destroy(Token *t)
-{
-    cfree((void*) t->text);
-    cfree(t);
-}
-
-LexerError *lexer_error_new(Lexer *lex, LexerErrorType type)
+LexerError *lexer_error_new(Lexer *lex, LexerErrorType type,
+                            const char *text, size_t length)
 {
     LexerError *err = cmalloc(sizeof(*err));
     int line = lex->line;
-    int column = lex->column - lexer_buffer_offset(lex->tbuf) + 1;
+    int column = lex->column - (int) length;
     err->type = type;
 
     switch (type) {
     case LEXER_ERROR_INVALID_TOKEN:
-        sprintf(err->text, "Token inválido `%s` en línea %d, columna %d",
-                lex->tbuf->data, line + 1, column + 1);
+        snprintf(err->text, sizeof(err->text),
+                 "Token inválido `%.*s` en línea %d, columna %d",
+                 length < LEXER_ERROR_TOKEN ? (int) length : LEXER_ERROR_TOKEN,
+                 text, line + 1, column + 1);
         break;
     case LEXER_ERROR_UNEXPECTED_EOF:
         strcpy(err->text, "No se esperaba fin de archivo");
@@ -2,16 +2,37 @@
 #define LEXER_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "buffer.h"
+#include "carena.h"
+#include "scan.h"
 
 #ifndef LEXER_BLOCK_SIZE
 #define LEXER_BLOCK_SIZE 512
 #endif
 
-#ifndef LEXER_TBUF_SIZE
-#define LEXER_TBUF_SIZE 64
+// Huecos del anillo del motor en dos hilos y cada cuántos tokens se publica
+// el avance de cada hilo
+#ifndef LEXER_PIPE_SIZE
+#define LEXER_PIPE_SIZE 4096
 #endif
 
+#ifndef LEXER_PIPE_BATCH
+#define LEXER_PIPE_BATCH 64
+#endif
+
+#ifndef LEXER_BATCH_SIZE
+#define LEXER_BATCH_SIZE 256
+#endif
+
+#ifndef LEXER_ARENA_SIZE
+#define LEXER_ARENA_SIZE 65536
+#endif
+
+// Bytes de un token que se citan como mucho en un mensaje de error, para que
+// la línea y la columna siempre quepan
+#define LEXER_ERROR_TOKEN 60
+
 typedef enum {
     LEXER_ERROR_NO_ERROR,
     LEXER_ERROR_INVALID_TOKEN,
@@ -25,12 +46,24 @@ typedef struct {
     int column;
 } LexerError;
 
+typedef struct LexerIndex LexerIndex;
+typedef struct LexerPipe LexerPipe;
+
 typedef struct {
     FILE *stream;
     LexerBuffer *block;
-    LexerBuffer *tbuf;
+    CArena *arena;
+    const ScanKernels *scan;
+    LexerIndex *index;
+    LexerPipe *pipe;
     LexerError *error;
+    int mapped;
+    int borrowed;       // La entrada pertenece a quien creó el lexer
+    int lines;          // Cada salto de línea termina una expresión
     int eof;
+    size_t offset;      // Posición en la entrada del inicio del bloque
+    size_t line_start;  // Posición en la entrada del inicio de la línea
+    size_t cr_end;      // Posición en la entrada tras el último "\r"
     int line;
     int column;
 } Lexer;
@@ -44,21 +77,79 @@ typedef enum {
     OPERATOR_ARITHMETIC,
     OPERATOR_RELATIONAL,
     OPERATOR_LOGICAL,
+    EXPRESSION_END,         // Salto de línea en el modo por líneas
 } TokenType;
 
+typedef enum {
+    OPERATOR_NONE,
+    OPERATOR_PLUS,
+    OPERATOR_MINUS,
+    OPERATOR_MUL,
+    OPERATOR_DIV,
+    OPERATOR_POW,
+    OPERATOR_EQ,
+    OPERATOR_LT,
+    OPERATOR_LE,
+    OPERATOR_GT,
+    OPERATOR_GE,
+    OPERATOR_AND,
+    OPERATOR_OR,
+} TokenOperator;
+
+// El texto no termina en NUL: apunta a la entrada proyectada o a la arena
 typedef struct {
     TokenType type;
+    TokenOperator op;
     const char *text;
+    size_t length;
+    size_t offset;          // Posición absoluta del token en la entrada
     int line;
     int column;
+    double value;           // Valor de los NUMBER, calculado al reconocerlos
 } Token;
 
+// Lote de tokens en arreglos paralelos, llenado por lexer_next_tokens. Un
+// error léxico que corta el lote se guarda en error y se entrega en la
+// siguiente llamada, cuando ya se han consumido los tokens anteriores.
+typedef struct {
+    uint8_t *type;          // TokenType
+    uint8_t *op;            // TokenOperator
+    const char **text;
+    size_t *offset;
+    size_t *length;
+    int *line;
+    int *column;
+    double *value;
+    size_t count;
+    size_t capacity;
+    LexerError *error;
+} TokenBatch;
+
+// Tokens de toda la entrada producidos por lexer_build_index
+struct LexerIndex {
+    Token *tokens;
+    size_t count;
+    size_t capacity;
+    size_t next;
+    LexerError *error;
+};
+
 Lexer *lexer_new(FILE *stream);
+Lexer *lexer_new_mmap(FILE *stream);
+Lexer *lexer_new_buffer(const char *data, size_t size);
+void lexer_set_origin(Lexer *lex, size_t offset, int line);
 void lexer_destroy(Lexer *lex);
+int lexer_build_index(Lexer *lex);
+int lexer_start_pipe(Lexer *lex);
 Token *lexer_next_token(Lexer *lex);
-Token *lexer_token_new(TokenType type, const char *text, int line, int column);
-void lexer_token_destroy(Token *t);
-LexerError *lexer_error_new(Lexer *lex, LexerErrorType type);
+size_t lexer_next_tokens(Lexer *lex, TokenBatch *batch, size_t max);
+TokenBatch *token_batch_new(size_t capacity);
+void token_batch_destroy(TokenBatch *batch);
+Token *lexer_token_new(Lexer *lex, TokenType type, TokenOperator op,
+                       const char *text, size_t length, size_t offset,
+                       int line, int column, double value);
+LexerError *lexer_error_new(Lexer *lex, LexerErrorType type,
+                            const char *text, size_t length);
 void lexer_error_destroy(LexerError *err);
 
 #endif
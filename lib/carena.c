@@ -0,0 +1,70 @@
+#include "carena.h"
+#include "cmem.h"
+
+// Los datos comienzan tras la cabecera, alineados a CARENA_ALIGN
+#define CARENA_HEADER_SIZE \
+    ((sizeof(CArenaChunk) + CARENA_ALIGN - 1) & ~(size_t) (CARENA_ALIGN - 1))
+
+static CArenaChunk *carena_chunk_new(size_t size, CArenaChunk *next)
+{
+    CArenaChunk *chunk = cmalloc(CARENA_HEADER_SIZE + size);
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->data = (char*) chunk + CARENA_HEADER_SIZE;
+    return chunk;
+}
+
+CArena *carena_new(size_t chunk_size)
+{
+    CArena *arena = cmalloc(sizeof(*arena));
+    arena->chunk_size = chunk_size;
+    arena->head = carena_chunk_new(chunk_size, NULL);
+    return arena;
+}
+
+void carena_destroy(CArena *arena)
+{
+    CArenaChunk *chunk = arena->head;
+    while (chunk != NULL) {
+        CArenaChunk *next = chunk->next;
+        cfree(chunk);
+        chunk = next;
+    }
+
+    cfree(arena);
+}
+
+void *carena_alloc(CArena *arena, size_t size)
+{
+    CArenaChunk *chunk = arena->head;
+    size = (size + CARENA_ALIGN - 1) & ~(size_t) (CARENA_ALIGN - 1);
+
+    if (chunk->size - chunk->used < size) {
+        size_t chunk_size = arena->chunk_size;
+        while (chunk_size < size) {
+            chunk_size *= 2;
+        }
+
+        chunk = carena_chunk_new(chunk_size, chunk);
+        arena->head = chunk;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+// Libera todo lo asignado conservando un solo bloque para reutilizarlo
+void carena_reset(CArena *arena)
+{
+    CArenaChunk *chunk = arena->head->next;
+    while (chunk != NULL) {
+        CArenaChunk *next = chunk->next;
+        cfree(chunk);
+        chunk = next;
+    }
+
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef LIB_CARENA_H
+#define LIB_CARENA_H
+
+#include <stddef.h>
+
+#define CARENA_ALIGN 16
+
+typedef struct CArenaChunk {
+    struct CArenaChunk *next;
+    size_t size;
+    size_t used;
+    char *data;
+} CArenaChunk;
+
+typedef struct {
+    CArenaChunk *head;
+    size_t chunk_size;
+} CArena;
+
+CArena *carena_new(size_t chunk_size);
+void carena_destroy(CArena *arena);
+void *carena_alloc(CArena *arena, size_t size);
+void carena_reset(CArena *arena);
+
+#endif
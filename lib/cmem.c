@@ -41,3 +41,20 @@ void *crealloc(void *ptr, size_t size)
 
     return ptr;
 }
+
+// Asegura sitio en ptr para need elementos de size bytes: si no caben en
+// *capacity, duplica la capacidad (desde CMEM_RESERVE_MIN) hasta que quepan
+void *creserve(void *ptr, size_t *capacity, size_t need, size_t size)
+{
+    if (need <= *capacity) {
+        return ptr;
+    }
+
+    size_t capacity_new = *capacity > 0 ? *capacity : CMEM_RESERVE_MIN;
+    while (capacity_new < need) {
+        capacity_new *= 2;
+    }
+
+    *capacity = capacity_new;
+    return crealloc(ptr, capacity_new * size);
+}
@@ -3,9 +3,15 @@
 
 #include <stdlib.h>
 
+// Capacidad con la que creserve empieza un arreglo vacío
+#ifndef CMEM_RESERVE_MIN
+#define CMEM_RESERVE_MIN 64
+#endif
+
 void *cmalloc(size_t size);
 void cfree(void *ptr);
 void *ccalloc(size_t nmemb, size_t size);
 void *crealloc(void *ptr, size_t size);
+void *creserve(void *ptr, size_t *capacity, size_t need, size_t size);
 
 #endif
@@ -0,0 +1,114 @@
+#include "cpool.h"
+#include "cdefs.h"
+#include "cmem.h"
+
+#ifdef CPOOL_HAVE_THREADS
+
+static int cpool_take(CPoolQueue *queue, size_t *index)
+{
+    int found = FALSE;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *index = queue->head++;
+        found = TRUE;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int cpool_steal(CPoolQueue *queue, size_t *index)
+{
+    int found = FALSE;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *index = --queue->tail;
+        found = TRUE;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void *cpool_worker_main(void *data)
+{
+    CPoolWorker *worker = data;
+    CPool *pool = worker->pool;
+    size_t index;
+
+    while (TRUE) {
+        if (cpool_take(&pool->queues[worker->id], &index)) {
+            pool->task(index, pool->arg);
+            continue;
+        }
+
+        // Cola propia vacía: se roba la última tarea de la siguiente cola
+        // que tenga trabajo. Las tareas no generan tareas nuevas, así que si
+        // todas están vacías no queda nada por hacer.
+        int stolen = FALSE;
+        for (size_t i = 1; i < pool->nworkers && !stolen; i++) {
+            size_t victim = (worker->id + i) % pool->nworkers;
+            stolen = cpool_steal(&pool->queues[victim], &index);
+        }
+
+        if (!stolen) {
+            return NULL;
+        }
+
+        pool->task(index, pool->arg);
+    }
+}
+
+#endif
+
+// Reparte ntasks tareas en bloques contiguos entre nworkers hilos y las
+// ejecuta en segundo plano. Sin hilos disponibles, se ejecutan aquí mismo.
+CPool *cpool_start(size_t nworkers, size_t ntasks, CPoolTask task, void *arg)
+{
+    CPool *pool = cmalloc(sizeof(*pool));
+    pool->task = task;
+    pool->arg = arg;
+    pool->nworkers = nworkers > 0 ? nworkers : 1;
+    pool->queues = cmalloc(pool->nworkers * sizeof(*pool->queues));
+    pool->workers = cmalloc(pool->nworkers * sizeof(*pool->workers));
+
+#ifdef CPOOL_HAVE_THREADS
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        CPoolQueue *queue = &pool->queues[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->head = ntasks * i / pool->nworkers;
+        queue->tail = ntasks * (i + 1) / pool->nworkers;
+    }
+
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        CPoolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->id = i;
+        pthread_create(&worker->thread, NULL, cpool_worker_main, worker);
+    }
+#else
+    for (size_t i = 0; i < ntasks; i++) {
+        task(i, arg);
+    }
+#endif
+
+    return pool;
+}
+
+// Espera a que terminen todas las tareas y libera el grupo
+void cpool_join(CPool *pool)
+{
+#ifdef CPOOL_HAVE_THREADS
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+#endif
+
+    cfree(pool->queues);
+    cfree(pool->workers);
+    cfree(pool);
+}
@@ -0,0 +1,43 @@
+#ifndef LIB_CPOOL_H
+#define LIB_CPOOL_H
+
+#include <stddef.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CPOOL_HAVE_THREADS
+#include <pthread.h>
+#endif
+
+typedef void (*CPoolTask)(size_t index, void *arg);
+
+// Cola de cada hilo: tareas [head, tail). El dueño toma por head y los demás
+// roban por tail.
+typedef struct {
+#ifdef CPOOL_HAVE_THREADS
+    pthread_mutex_t lock;
+#endif
+    size_t head;
+    size_t tail;
+} CPoolQueue;
+
+typedef struct CPool CPool;
+typedef struct {
+    CPool *pool;
+    size_t id;
+#ifdef CPOOL_HAVE_THREADS
+    pthread_t thread;
+#endif
+} CPoolWorker;
+
+struct CPool {
+    CPoolTask task;
+    void *arg;
+    size_t nworkers;
+    CPoolQueue *queues;
+    CPoolWorker *workers;
+};
+
+CPool *cpool_start(size_t nworkers, size_t ntasks, CPoolTask task, void *arg);
+void cpool_join(CPool *pool);
+
+#endif
@@ -1,99 +1,740 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "cdefs.h"
 #include "cmem.h"
+#include "cpool.h"
+#include "evaluator.h"
+#include "jit.h"
+#include "optimizer.h"
 #include "parser.h"
 #include "stack.h"
 
+#ifdef CPOOL_HAVE_THREADS
+#include <unistd.h>
+#endif
+
 #define TEXT_DELIM "--------------------------------\n"
 
-static const char *filename;
+// Archivo en análisis y destino de sus resultados. Cada análisis tiene el
+// suyo, de modo que varios pueden ejecutarse a la vez.
+typedef struct {
+    const char *filename;
+    FILE *out;
+    FILE *err;
+    ParserTrace *trace;
+    Dag *dag;
+    Evaluator *eval;
+} ParseJob;
+
+static int use_index = FALSE;
+static int use_trace = TRUE;
+static int use_lines = FALSE;
+static int use_pipe = FALSE;
+static int use_ast = FALSE;
+static int use_rpn = FALSE;
+static int use_eval = FALSE;
+static int use_optimize = FALSE;
+static int use_dag = FALSE;
+static const char **bind_names = NULL;    // Valores dados con -D
+static double *bind_values = NULL;
+static int bind_count = 0;
+static long bench_runs = 0;     // Evaluaciones de cada medida de -b
+static long line_jobs = 1;      // Hilos por archivo en el modo por líneas
+static ParserTrace *trace = NULL;
 
-static void pstos(char *dest, ParserStack *stack)
+// La pila puede ser arbitrariamente profunda: se escribe directamente
+static void print_stack(ParseJob *job, ParserStack *stack)
 {
-    *dest++ = '{';
-    for (int i = stack->size - 1; i >= 0; i--) {
-        dest += sprintf(dest, "%d", stack->data[i]);
-        if (i > 0) {
-            dest += sprintf(dest, ", ");
-        }
+    fprintf(job->err, "%s: Pila -> {", job->filename);
+    for (size_t i = stack->size; i > 0; i--) {
+        fprintf(job->err, i > 1 ? "%d, " : "%d", stack->data[i - 1]);
     }
 
-    *dest++ = '}';
-    *dest = 0;
+    fputs("}\n", job->err);
 }
 
 static void beforeproc_func(const char *name, Parser *p)
 {
-    char stack_str[1024];
-    pstos(stack_str, p->stack);
-    fprintf(stderr, "%s: Inicio procedimiento %s\n", filename, name);
-    fprintf(stderr, "%s: Pila -> %s\n", filename, stack_str);
+    ParseJob *job = p->data;
+    fprintf(job->err, "%s: Inicio procedimiento %s\n", job->filename, name);
+    print_stack(job, p->stack);
 
     if (p->token != NULL) {
-        fprintf(stderr, "%s: Token -> `%s` (tipo %d)\n",
-                filename, p->token->text, p->token->type);
+        fprintf(job->err, "%s: Token -> `%.*s` (tipo %d)\n", job->filename,
+                (int) p->token->length, p->token->text, p->token->type);
     } else {
-        fprintf(stderr, "%s: Fin de secuencia\n", filename);
+        fprintf(job->err, "%s: Fin de secuencia\n", job->filename);
     }
 }
 
 static void afterproc_func(const char *name, Parser *p)
 {
-    char stack_str[1024];
-    pstos(stack_str, p->stack);
-    fprintf(stderr, "%s: Pila -> %s\n", filename, stack_str);
-    fprintf(stderr, "%s: Fin procedimiento %s\n", filename, name);
-    fprintf(stderr, TEXT_DELIM);
+    ParseJob *job = p->data;
+    print_stack(job, p->stack);
+    fprintf(job->err, "%s: Fin procedimiento %s\n", job->filename, name);
+    fprintf(job->err, TEXT_DELIM);
+}
+
+static void parse_hooks(ParseJob *job, Parser *p)
+{
+    p->data = job;
+    if (use_ast) {
+        p->ast = ast_new();
+    }
+
+    if (use_rpn || use_eval || use_optimize || use_dag) {
+        p->rpn = rpn_new();
+    }
+
+    job->dag = use_dag ? dag_new() : NULL;
+    job->eval = use_eval ? evaluator_new() : NULL;
+    if (job->trace != NULL) {
+        p->trace = job->trace;
+    } else if (use_trace) {
+        p->beforeproc = &beforeproc_func;
+        p->afterproc = &afterproc_func;
+    }
+}
+
+static void parse_done(ParseJob *job, Parser *p)
+{
+    if (job->dag != NULL) {
+        dag_destroy(job->dag);
+    }
+
+    if (job->eval != NULL) {
+        evaluator_destroy(job->eval);
+    }
+
+    if (p->ast != NULL) {
+        ast_destroy(p->ast);
+    }
+
+    if (p->rpn != NULL) {
+        rpn_destroy(p->rpn);
+    }
+
+    parser_destroy_all(p);
+}
+
+static void print_prefix(ParseJob *job, int line, const char *what)
+{
+    if (line > 0) {
+        fprintf(job->out, "%s:%d: %s -> ", job->filename, line, what);
+    } else {
+        fprintf(job->out, "%s: %s -> ", job->filename, what);
+    }
+}
+
+// Valor de la expresión con los identificadores dados con -D; devuelve FALSE
+// si alguno no tiene valor
+static int print_value(ParseJob *job, Parser *p)
+{
+    Rpn *rpn = p->rpn;
+    evaluator_load(job->eval, rpn);
+    for (uint32_t i = 0; i < rpn->name_count; i++) {
+        const RpnName *n = &rpn->names[i];
+        const char *name = rpn->text + n->offset;
+        int j = 0;
+        while (j < bind_count && (strlen(bind_names[j]) != n->length ||
+                                  memcmp(bind_names[j], name, n->length) != 0))
+        {
+            j++;
+        }
+
+        if (j == bind_count) {
+            fprintf(job->out, "identificador `%.*s` sin valor\n",
+                    (int) n->length, name);
+            return FALSE;
+        }
+
+        *evaluator_value(job->eval, i) = bind_values[j];
+    }
+
+    char value[RPN_NUMBER_TEXT];
+    rpn_format_number(value, evaluator_run(job->eval));
+    fprintf(job->out, "%s\n", value);
+    return TRUE;
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Nanosegundos por evaluación del intérprete y del código compilado
+static void print_bench(ParseJob *job, int line)
+{
+    Evaluator *ev = job->eval;
+    volatile double sink = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < bench_runs; i++) {
+        sink = evaluator_interpret(ev);
+    }
+
+    double interpreted = elapsed_ns(&start) / bench_runs;
+    print_prefix(job, line, "Tiempo");
+    fprintf(job->out, "intérprete %.1f ns", interpreted);
+
+    Jit *jit = jit_compile(ev->code, ev->count, ev->depth);
+    if (jit == NULL) {
+        fputs(", sin JIT\n", job->out);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < bench_runs; i++) {
+        sink = jit->func(ev->slots);
+    }
+
+    double compiled = elapsed_ns(&start) / bench_runs;
+    fprintf(job->out, ", JIT %.1f ns (x%.1f)\n", compiled,
+            interpreted / compiled);
+    jit_destroy(jit);
+    (void) sink;
+}
+
+// Árbol, postfija, grafo y valor de la expresión aceptada, si se pidieron;
+// line es 0 fuera del modo por líneas. Con -O la postfija, el grafo y el
+// valor son los de la expresión simplificada.
+static void print_output(ParseJob *job, Parser *p, int line)
+{
+    if (use_ast) {
+        print_prefix(job, line, "AST");
+        ast_print(p->ast, p->ast->root, job->out);
+        fputc('\n', job->out);
+    }
+
+    if (use_optimize) {
+        print_prefix(job, line, "Optimización");
+        fprintf(job->out, "%u nodos eliminados\n",
+                (unsigned) optimizer_fold(p->rpn));
+    }
+
+    if (use_rpn) {
+        print_prefix(job, line, "RPN");
+        rpn_print(p->rpn, job->out);
+        fputc('\n', job->out);
+    }
+
+    if (use_dag) {
+        dag_build(job->dag, p->rpn);
+        print_prefix(job, line, "DAG");
+        fprintf(job->out, "%u nodos, %u compartidos: ",
+                (unsigned) job->dag->count, (unsigned) job->dag->shared);
+        dag_print(job->dag, p->rpn, job->out);
+        fputc('\n', job->out);
+    }
+
+    if (use_eval) {
+        print_prefix(job, line, "Valor");
+        if (print_value(job, p) && bench_runs > 0) {
+            print_bench(job, line);
+        }
+    }
+}
+
+// Escribe una línea de resultado por expresión y acumula los totales
+static void parse_lines(ParseJob *job, Parser *p, size_t *accepted,
+                        size_t *rejected)
+{
+    while (parser_parse_next(p)) {
+        if (p->error != NULL) {
+            fprintf(job->out, "%s:%d: Secuencia rechazada: %s\n",
+                    job->filename, p->line + 1, p->error->text);
+            (*rejected)++;
+        } else {
+            fprintf(job->out, "%s:%d: Secuencia aceptada\n", job->filename,
+                    p->line + 1);
+            print_output(job, p, p->line + 1);
+            (*accepted)++;
+        }
+    }
+}
+
+#ifdef CPOOL_HAVE_THREADS
+
+// Salida de una tarea en paralelo, retenida en memoria hasta que le toque
+// imprimirse
+typedef struct {
+    char *out;
+    size_t out_size;
+    char *err;
+    size_t err_size;
+    char *trace;
+    size_t trace_size;
+    int done;
+} ParseResult;
+
+// Tareas cuyos resultados se imprimen en orden. El hilo principal hace de
+// búfer de reordenación: imprime cada resultado en cuanto están listos todos
+// los anteriores.
+typedef struct {
+    ParseResult *results;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    void *data;
+} ParseBatch;
+
+static void parse_batch_init(ParseBatch *batch, size_t size, void *data)
+{
+    batch->results = ccalloc(size, sizeof(*batch->results));
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->cond, NULL);
+    batch->data = data;
+}
+
+static void parse_batch_destroy(ParseBatch *batch)
+{
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    cfree(batch->results);
 }
 
-static void parse_file()
+// Redirige la salida de job a la memoria del resultado index
+static void parse_batch_open(ParseBatch *batch, size_t index, ParseJob *job,
+                             int traced)
+{
+    ParseResult *r = &batch->results[index];
+    job->out = open_memstream(&r->out, &r->out_size);
+    job->err = open_memstream(&r->err, &r->err_size);
+    job->trace = NULL;
+    if (traced) {
+        job->trace = parser_trace_new(open_memstream(&r->trace,
+                                                     &r->trace_size));
+    }
+}
+
+static void parse_batch_done(ParseBatch *batch, size_t index, ParseJob *job)
+{
+    fclose(job->out);
+    fclose(job->err);
+    if (job->trace != NULL) {
+        parser_trace_destroy(job->trace);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->results[index].done = TRUE;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+// Espera al resultado index y lo escribe en los flujos de job
+static void parse_batch_print(ParseBatch *batch, size_t index, ParseJob *job)
+{
+    ParseResult *r = &batch->results[index];
+    pthread_mutex_lock(&batch->lock);
+    while (!r->done) {
+        pthread_cond_wait(&batch->cond, &batch->lock);
+    }
+
+    pthread_mutex_unlock(&batch->lock);
+    fwrite(r->err, 1, r->err_size, job->err);
+    fwrite(r->out, 1, r->out_size, job->out);
+    if (r->trace != NULL) {
+        fwrite(r->trace, 1, r->trace_size, job->trace->stream);
+    }
+
+    free(r->out);
+    free(r->err);
+    free(r->trace);
+}
+
+// Tamaño mínimo de los fragmentos en que se divide un archivo por líneas
+#ifndef PARSE_CHUNK_MIN
+#define PARSE_CHUNK_MIN (1 << 20)
+#endif
+
+typedef struct {
+    size_t start;
+    size_t size;
+    int line;               // Línea en la que empieza el fragmento
+    size_t accepted;
+    size_t rejected;
+} LineChunk;
+
+typedef struct {
+    ParseJob *job;
+    const char *data;
+    LineChunk *chunks;
+} LineContext;
+
+// Saltos de línea del fragmento, contados como lo hace el lexer: "\r", "\n"
+// y "\r\n" valen uno
+static void line_count_task(size_t index, void *arg)
+{
+    ParseBatch *batch = arg;
+    LineContext *ctx = batch->data;
+    LineChunk *chunk = &ctx->chunks[index];
+    const char *data = ctx->data;
+    int lines = 0;
+
+    for (size_t i = chunk->start; i < chunk->start + chunk->size; i++) {
+        if (data[i] == '\r' ||
+            (data[i] == '\n' && (i == 0 || data[i - 1] != '\r')))
+        {
+            lines++;
+        }
+    }
+
+    chunk->line = lines;
+}
+
+static void line_parse_task(size_t index, void *arg)
+{
+    ParseBatch *batch = arg;
+    LineContext *ctx = batch->data;
+    LineChunk *chunk = &ctx->chunks[index];
+    ParseJob job;
+    job.filename = ctx->job->filename;
+    parse_batch_open(batch, index, &job, ctx->job->trace != NULL);
+
+    Lexer *lex = lexer_new_buffer(ctx->data + chunk->start, chunk->size);
+    lex->lines = TRUE;
+    lexer_set_origin(lex, chunk->start, chunk->line);
+    Parser *p = parser_new(lex);
+    parse_hooks(&job, p);
+    parse_lines(&job, p, &chunk->accepted, &chunk->rejected);
+    parse_done(&job, p);
+    parse_batch_done(batch, index, &job);
+}
+
+// Fragmentos en que se reparte el archivo de lex entre njobs hilos; 0 si no
+// está proyectado o es demasiado pequeño para repartirlo
+static size_t parse_line_chunks(const Lexer *lex, size_t njobs)
+{
+    size_t size = lex->block->size;
+    size_t nchunks = njobs * 4;
+    if (size / nchunks < PARSE_CHUNK_MIN) {
+        nchunks = size / PARSE_CHUNK_MIN;
+    }
+
+    return lex->mapped && nchunks >= 2 ? nchunks : 0;
+}
+
+/*
+ * Analiza por fragmentos un archivo proyectado en modo por líneas. Los cortes
+ * se hacen tras un "\n", así que ninguna expresión queda partida. Una primera
+ * pasada cuenta los saltos de línea de cada fragmento y su suma acumulada da
+ * la línea inicial de cada uno; con ella los mensajes coinciden con los del
+ * análisis secuencial. Cada fragmento tiene su propio lexer, así que el de
+ * lex solo aporta la entrada proyectada.
+ */
+static void parse_lines_parallel(ParseJob *job, Lexer *lex, size_t njobs,
+                                 size_t nchunks, size_t *accepted,
+                                 size_t *rejected)
+{
+    const char *data = lex->block->data;
+    size_t size = lex->block->size;
+    LineChunk *chunks = ccalloc(nchunks, sizeof(*chunks));
+    size_t count = 0;
+    size_t start = 0;
+    for (size_t i = 1; i <= nchunks && start < size; i++) {
+        size_t end = size;
+        if (i < nchunks) {
+            end = size * i / nchunks;
+            if (end < start) {
+                continue;
+            }
+
+            const char *nl = memchr(data + end, '\n', size - end);
+            end = nl != NULL ? (size_t) (nl - data) + 1 : size;
+        }
+
+        chunks[count].start = start;
+        chunks[count].size = end - start;
+        count++;
+        start = end;
+    }
+
+    LineContext ctx;
+    ctx.job = job;
+    ctx.data = data;
+    ctx.chunks = chunks;
+
+    ParseBatch batch;
+    parse_batch_init(&batch, count, &ctx);
+    cpool_join(cpool_start(njobs, count, line_count_task, &batch));
+
+    int line = 0;
+    for (size_t i = 0; i < count; i++) {
+        int lines = chunks[i].line;
+        chunks[i].line = line;
+        line += lines;
+    }
+
+    CPool *pool = cpool_start(njobs, count, line_parse_task, &batch);
+    for (size_t i = 0; i < count; i++) {
+        parse_batch_print(&batch, i, job);
+    }
+
+    cpool_join(pool);
+    for (size_t i = 0; i < count; i++) {
+        *accepted += chunks[i].accepted;
+        *rejected += chunks[i].rejected;
+    }
+
+    parse_batch_destroy(&batch);
+    cfree(chunks);
+}
+
+#endif
+
+static void parse_file(ParseJob *job)
 {
     FILE *f;
-    int is_stdin = strcmp(filename, "-") == 0;
+    int is_stdin = strcmp(job->filename, "-") == 0;
 
     if (!is_stdin) {
-        f = fopen(filename, "rb");
+        f = fopen(job->filename, "rb");
         if (f == NULL) {
-            fprintf(stderr, "c-ompiler: ");
-            perror(filename);
+            fprintf(job->err, "c-ompiler: %s: %s\n", job->filename,
+                    strerror(errno));
             return;
         }
     } else {
         f = stdin;
-        filename = "STDIN";
+        job->filename = "STDIN";
     }
 
-    printf("Analizando %s\n", filename);
-    printf(TEXT_DELIM);
-    Lexer *lex = lexer_new(f);
-    Parser *p = parser_new(lex);
-    p->beforeproc = &beforeproc_func;
-    p->afterproc = &afterproc_func;
-    parser_parse(p);
+    fprintf(job->out, "Analizando %s\n", job->filename);
+    fprintf(job->out, TEXT_DELIM);
+    Lexer *lex = is_stdin ? lexer_new(f) : lexer_new_mmap(f);
+    lex->lines = use_lines;
+    if (job->trace != NULL) {
+        parser_trace_begin(job->trace, job->filename);
+    }
 
-    if (p->error != NULL) {
-        printf("%s: Error: %s\n", filename, p->error->text);
-        printf("%s: Secuencia rechazada\n", filename);
+#ifdef CPOOL_HAVE_THREADS
+    // Los fragmentos tienen sus propios lexers y parsers: este no necesita
+    // índice, hilo productor ni parser
+    size_t nchunks = use_lines && line_jobs > 1 ?
+                     parse_line_chunks(lex, line_jobs) : 0;
+    if (nchunks > 0) {
+        size_t accepted = 0;
+        size_t rejected = 0;
+        parse_lines_parallel(job, lex, line_jobs, nchunks, &accepted,
+                             &rejected);
+        fprintf(job->out, "%s: %zu aceptadas, %zu rechazadas\n",
+                job->filename, accepted, rejected);
+        if (job->trace != NULL) {
+            parser_trace_end(job->trace);
+        }
+
+        fprintf(job->out, TEXT_DELIM);
+        lexer_destroy(lex);
+        return;
+    }
+#endif
+
+    if (use_index) {
+        lexer_build_index(lex);
+    }
+
+    if (use_pipe) {
+        lexer_start_pipe(lex);
+    }
+
+    Parser *p = parser_new(lex);
+    parse_hooks(job, p);
+    if (use_lines) {
+        size_t accepted = 0;
+        size_t rejected = 0;
+        parse_lines(job, p, &accepted, &rejected);
+        fprintf(job->out, "%s: %zu aceptadas, %zu rechazadas\n",
+                job->filename, accepted, rejected);
     } else {
-        printf("%s: Secuencia aceptada\n", filename);
+        parser_parse(p);
+        if (p->error != NULL) {
+            fprintf(job->out, "%s: Error: %s\n", job->filename,
+                    p->error->text);
+            fprintf(job->out, "%s: Secuencia rechazada\n", job->filename);
+        } else {
+            fprintf(job->out, "%s: Secuencia aceptada\n", job->filename);
+            print_output(job, p, 0);
+        }
     }
 
-    printf(TEXT_DELIM);
-    parser_destroy_all(p);
+    if (job->trace != NULL) {
+        parser_trace_end(job->trace);
+    }
+
+    fprintf(job->out, TEXT_DELIM);
+    parse_done(job, p);
+}
+
+#ifdef CPOOL_HAVE_THREADS
+
+static void parse_task(size_t index, void *arg)
+{
+    ParseBatch *batch = arg;
+    char **files = batch->data;
+    ParseJob job;
+    job.filename = files[index];
+    parse_batch_open(batch, index, &job, trace != NULL);
+    parse_file(&job);
+    parse_batch_done(batch, index, &job);
+}
+
+// Reparte los archivos entre njobs hilos y los imprime en el orden de la línea
+// de órdenes
+static void parse_files_parallel(char **files, size_t nfiles, size_t njobs)
+{
+    ParseJob job;
+    job.out = stdout;
+    job.err = stderr;
+    job.trace = trace;
+
+    ParseBatch batch;
+    parse_batch_init(&batch, nfiles, files);
+    CPool *pool = cpool_start(njobs, nfiles, parse_task, &batch);
+    for (size_t i = 0; i < nfiles; i++) {
+        parse_batch_print(&batch, i, &job);
+    }
+
+    cpool_join(pool);
+    parse_batch_destroy(&batch);
+}
+
+#endif
+
+// Libera lo que reservaron las opciones (-t, -D)
+static void options_destroy(void)
+{
+    if (trace != NULL) {
+        parser_trace_destroy(trace);
+    }
+
+    cfree(bind_names);
+    cfree(bind_values);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc > 1) {
-        for (char **f = argv + 1; *f != NULL; f++) {
-            filename = *f;
-            parse_file();
+    int nfiles = 0;
+    long njobs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--index") == 0) {
+            use_index = TRUE;
+        } else if (strcmp(argv[i], "-l") == 0 ||
+                   strcmp(argv[i], "--lines") == 0) {
+            use_lines = TRUE;
+        } else if (strcmp(argv[i], "-p") == 0 ||
+                   strcmp(argv[i], "--pipeline") == 0) {
+            use_pipe = TRUE;
+        } else if (strcmp(argv[i], "-a") == 0 ||
+                   strcmp(argv[i], "--ast") == 0) {
+            use_ast = TRUE;
+        } else if (strcmp(argv[i], "-r") == 0 ||
+                   strcmp(argv[i], "--rpn") == 0) {
+            use_rpn = TRUE;
+        } else if (strcmp(argv[i], "-e") == 0 ||
+                   strcmp(argv[i], "--eval") == 0) {
+            use_eval = TRUE;
+        } else if (strcmp(argv[i], "-g") == 0 ||
+                   strcmp(argv[i], "--dag") == 0) {
+            use_dag = TRUE;
+        } else if (strcmp(argv[i], "-O") == 0 ||
+                   strcmp(argv[i], "--optimize") == 0) {
+            use_optimize = TRUE;
+        } else if ((strcmp(argv[i], "-b") == 0 ||
+                    strcmp(argv[i], "--bench") == 0) && i + 1 < argc)
+        {
+            use_eval = TRUE;
+            bench_runs = strtol(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "-D") == 0 ||
+                    strcmp(argv[i], "--define") == 0) && i + 1 < argc)
+        {
+            char *binding = argv[++i];
+            char *equals = strchr(binding, '=');
+            char *end = NULL;
+            double value = 0;
+            if (equals != NULL) {
+                value = strtod(equals + 1, &end);
+            }
+
+            if (equals == NULL || end == equals + 1 || *end != '\0') {
+                fprintf(stderr, "c-ompiler: se esperaba NOMBRE=VALOR: %s\n",
+                        binding);
+                options_destroy();
+                return 1;
+            }
+
+            if (bind_names == NULL) {
+                bind_names = cmalloc(argc * sizeof(*bind_names));
+                bind_values = cmalloc(argc * sizeof(*bind_values));
+            }
+
+            *equals = '\0';
+            bind_names[bind_count] = binding;
+            bind_values[bind_count++] = value;
+        } else if (strcmp(argv[i], "-q") == 0 ||
+                   strcmp(argv[i], "--no-trace") == 0) {
+            use_trace = FALSE;
+        } else if ((strcmp(argv[i], "-t") == 0 ||
+                    strcmp(argv[i], "--trace") == 0) && i + 1 < argc)
+        {
+            FILE *f = fopen(argv[++i], "wb");
+            if (f == NULL) {
+                fprintf(stderr, "c-ompiler: ");
+                perror(argv[i]);
+                options_destroy();
+                return 1;
+            }
+
+            if (trace != NULL) {
+                parser_trace_destroy(trace);
+            }
+
+            trace = parser_trace_new(f);
+        } else if ((strcmp(argv[i], "-j") == 0 ||
+                    strcmp(argv[i], "--jobs") == 0) && i + 1 < argc)
+        {
+            njobs = strtol(argv[++i], NULL, 10);
+        } else {
+            argv[++nfiles] = argv[i];
+        }
+    }
+
+#ifdef CPOOL_HAVE_THREADS
+    if (njobs <= 0) {
+        njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // Con un solo archivo los hilos se reparten sus líneas
+    if (nfiles <= 1) {
+        line_jobs = njobs;
+    } else if (njobs > nfiles) {
+        njobs = nfiles;
+    }
+
+    if (nfiles > 1 && njobs > 1) {
+        parse_files_parallel(argv + 1, nfiles, njobs);
+        options_destroy();
+        return 0;
+    }
+#endif
+
+    ParseJob job;
+    job.out = stdout;
+    job.err = stderr;
+    job.trace = trace;
+    if (nfiles > 0) {
+        for (int i = 1; i <= nfiles; i++) {
+            job.filename = argv[i];
+            parse_file(&job);
         }
     } else {
-        filename = "-";
-        parse_file();
+        job.filename = "-";
+        parse_file(&job);
     }
 
+    options_destroy();
     return 0;
 }
@@ -0,0 +1,22 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+
+/*
+ * Valor de un literal numérico tal como lo acepta el lexer: dígitos con, como
+ * mucho, un punto ("12", "12.", "12.5", ".5"). El texto no tiene que terminar
+ * en NUL. El resultado es el double más cercano, el mismo que daría strtod en
+ * la configuración regional "C":
+ *
+ * - Los enteros de hasta 2^53 se convierten directamente.
+ * - Si la mantisa decimal cabe en 53 bits y el exponente en [-22, 22] basta
+ *   una multiplicación o división exacta (Clinger).
+ * - Si no, se multiplica la mantisa por una aproximación de 128 bits de la
+ *   potencia de 10 (Eisel-Lemire), que casi siempre decide el redondeo.
+ * - Los casos que quedan (más de 19 cifras que no deciden, desbordamientos,
+ *   subnormales) pasan por strtod.
+ */
+double number_parse(const char *text, size_t length);
+
+#endif
@@ -0,0 +1,175 @@
+#include "optimizer.h"
+#include <math.h>
+#include <string.h>
+#include "cdefs.h"
+#include "cmem.h"
+#include "evaluator.h"
+
+// Subexpresión ya reescrita: empieza en code[start] y, si es constante, vale
+// value
+typedef struct {
+    uint32_t start;
+    int constant;
+    double value;
+} OptimizerValue;
+
+typedef enum {
+    OPTIMIZER_KEEP,         // Se mantiene el operador
+    OPTIMIZER_LEFT,         // El resultado es el operando izquierdo
+    OPTIMIZER_RIGHT,        // El resultado es el operando derecho
+    OPTIMIZER_CONSTANT,     // El resultado es una constante
+} OptimizerRule;
+
+static int optimizer_is(const OptimizerValue *v, double value)
+{
+    return v->constant && v->value == value;
+}
+
+// Distingue -0 de +0, que == no separa
+static int optimizer_is_zero(const OptimizerValue *v, int negative)
+{
+    return optimizer_is(v, 0) && !signbit(v->value) == !negative;
+}
+
+static OptimizerRule optimizer_rule(TokenOperator op, const OptimizerValue *a,
+                                    const OptimizerValue *b, double *value)
+{
+    if (a->constant && b->constant) {
+        *value = evaluator_apply(op, a->value, b->value);
+        return OPTIMIZER_CONSTANT;
+    }
+
+    switch (op) {
+    case OPERATOR_PLUS:
+        if (optimizer_is_zero(b, TRUE)) {
+            return OPTIMIZER_LEFT;
+        } else if (optimizer_is_zero(a, TRUE)) {
+            return OPTIMIZER_RIGHT;
+        }
+        break;
+    case OPERATOR_MINUS:
+        if (optimizer_is_zero(b, FALSE)) {
+            return OPTIMIZER_LEFT;
+        }
+        break;
+    case OPERATOR_MUL:
+        if (optimizer_is(b, 1)) {
+            return OPTIMIZER_LEFT;
+        } else if (optimizer_is(a, 1)) {
+            return OPTIMIZER_RIGHT;
+        }
+        break;
+    case OPERATOR_DIV:
+        if (optimizer_is(b, 1)) {
+            return OPTIMIZER_LEFT;
+        }
+        break;
+    case OPERATOR_POW:
+        // pow(x, ±0) y pow(1, y) valen 1 incluso con NaN
+        if (optimizer_is(b, 1)) {
+            return OPTIMIZER_LEFT;
+        } else if (optimizer_is(b, 0) || optimizer_is(a, 1)) {
+            *value = 1;
+            return OPTIMIZER_CONSTANT;
+        }
+        break;
+    case OPERATOR_AND:
+        if (optimizer_is(a, 0) || optimizer_is(b, 0)) {
+            *value = 0;
+            return OPTIMIZER_CONSTANT;
+        }
+        break;
+    case OPERATOR_OR:
+        // NaN != 0, así que también cuenta como verdadero
+        if ((a->constant && a->value != 0) || (b->constant && b->value != 0)) {
+            *value = 1;
+            return OPTIMIZER_CONSTANT;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return OPTIMIZER_KEEP;
+}
+
+/*
+ * Reescribe el programa en su propio arreglo: la posición de escritura nunca
+ * adelanta a la de lectura. La pila guarda dónde empieza cada subexpresión ya
+ * escrita, así que descartar un operando es retroceder (o mover el otro a su
+ * sitio) y plegar uno es sustituir todo el subárbol por un número.
+ */
+uint32_t optimizer_fold(Rpn *rpn)
+{
+    if (!rpn->complete || rpn->count == 0) {
+        return 0;
+    }
+
+    RpnInstruction *code = rpn->code;
+    OptimizerValue *stack = cmalloc(rpn->count * sizeof(*stack));
+    double *values = cmalloc(rpn->count * sizeof(*values));
+    size_t top = 0;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < rpn->count; i++) {
+        RpnInstruction ins = code[i];
+        if (ins.kind != RPN_OPERATOR) {
+            OptimizerValue *v = &stack[top++];
+            v->start = count;
+            v->constant = ins.kind == RPN_NUMBER;
+            if (v->constant) {
+                v->value = rpn->numbers[ins.arg];
+                values[count] = v->value;
+            }
+
+            code[count++] = ins;
+            continue;
+        }
+
+        OptimizerValue *b = &stack[--top];
+        OptimizerValue *a = &stack[top - 1];
+        double value = 0;
+        switch (optimizer_rule(ins.op, a, b, &value)) {
+        case OPTIMIZER_KEEP:
+            a->constant = FALSE;
+            code[count++] = ins;
+            break;
+        case OPTIMIZER_LEFT:
+            count = b->start;
+            break;
+        case OPTIMIZER_RIGHT:
+            memmove(&code[a->start], &code[b->start],
+                    (count - b->start) * sizeof(*code));
+            memmove(&values[a->start], &values[b->start],
+                    (count - b->start) * sizeof(*values));
+            count = a->start + (count - b->start);
+            a->constant = FALSE;
+            break;
+        case OPTIMIZER_CONSTANT:
+            count = a->start;
+            a->constant = TRUE;
+            a->value = value;
+            values[count] = value;
+            code[count].kind = RPN_NUMBER;
+            code[count].op = OPERATOR_NONE;
+            count++;
+            break;
+        }
+    }
+
+    // Cada número que queda sustituye al menos a uno de los originales, así
+    // que la tabla tiene sitio para todos
+    uint32_t number_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (code[i].kind == RPN_NUMBER) {
+            rpn->numbers[number_count] = values[i];
+            code[i].arg = number_count++;
+        }
+    }
+
+    uint32_t removed = rpn->count - count;
+    rpn->count = count;
+    rpn->number_count = number_count;
+    cfree(stack);
+    cfree(values);
+    return removed;
+}
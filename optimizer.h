@@ -0,0 +1,25 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stdint.h>
+#include "rpn.h"
+
+/*
+ * Simplifica una expresión aceptada antes de evaluarla, sin cambiar su valor
+ * para ningún double (ni siquiera el signo de los ceros o los NaN):
+ *
+ * - Pliega las subexpresiones formadas solo por números, calculándolas con
+ *   evaluator_apply igual que lo haría el evaluador.
+ * - Elimina los operandos neutros exactos: x * 1, 1 * x, x / 1, x ^ 1,
+ *   x - 0 y x + (-0). x + 0 no se toca: con x = -0 vale +0.
+ * - Sustituye por su valor los resultados que no dependen del otro operando:
+ *   x ^ 0 y 1 ^ x valen 1, x & 0 y 0 & x valen 0, y x | c y c | x valen 1
+ *   para cualquier constante c distinta de 0, NaN incluido.
+ *
+ * La tabla de números queda con una constante por instrucción que la usa; la
+ * de nombres no cambia, aunque algún identificador deje de aparecer.
+ * Devuelve cuántas instrucciones (nodos) se han eliminado.
+ */
+uint32_t optimizer_fold(Rpn *rpn);
+
+#endif
@@ -3,22 +3,23 @@
 #include "cdefs.h"
 #include "cmem.h"
 
-enum ParserStackSymbols {
-    PARSER_SYMBOL_BOTTOM,           // Fondo de pila
-    PARSER_SYMBOL_NONTERM_A,        // <A> (Axioma)
-    PARSER_SYMBOL_NONTERM_AP,       // <A'>
-    PARSER_SYMBOL_NONTERM_B,        // <B>
-    PARSER_SYMBOL_NONTERM_BP,       // <B'>
-    PARSER_SYMBOL_NONTERM_C,        // <C>
-    PARSER_SYMBOL_NONTERM_CP,       // <C'>
-    PARSER_SYMBOL_NONTERM_D,        // <D>
-    PARSER_SYMBOL_NONTERM_DP,       // <D'>
-    PARSER_SYMBOL_NONTERM_E,        // <E>
-    PARSER_SYMBOL_NONTERM_EP,       // <E'>
-    PARSER_SYMBOL_NONTERM_F,        // <F>
-    PARSER_SYMBOL_TERM_RP,          // ")"
+// Terminales de la tabla de análisis
+enum ParserTerminals {
+    PARSER_TERMINAL_OPERAND,        // id | num
+    PARSER_TERMINAL_PL,             // "("
+    PARSER_TERMINAL_PR,             // ")"
+    PARSER_TERMINAL_OA1,            // "+" | "-"
+    PARSER_TERMINAL_OA2,            // "*" | "/"
+    PARSER_TERMINAL_OA3,            // "^"
+    PARSER_TERMINAL_OR,             // "=" | "<" | "<=" | ">" | ">="
+    PARSER_TERMINAL_OL,             // "&" | "|"
+    PARSER_TERMINAL_END,            // ¬
+    PARSER_TERMINAL_COUNT,
 };
 
+#define PARSER_PROC_REJECT 0
+#define PARSER_PROC_ACCEPT PARSER_PROC_COUNT
+
 ParserError *parser_error_new(Parser *p, ParserErrorType type)
 {
     ParserError *err = cmalloc(sizeof(*err));
@@ -26,11 +27,17 @@ ParserError *parser_error_new(Parser *p, ParserErrorType type)
 
     switch (type) {
     case PARSER_ERROR_LEXER_ERROR:
-        sprintf(err->text, "Error léxico: %s", p->lex->error->text);
+        // El texto del lexer ocupa como mucho lo que deja el prefijo
+        snprintf(err->text, sizeof(err->text), "Error léxico: %.*s",
+                 (int) (sizeof(err->text) - sizeof("Error léxico: ")),
+                 p->lex->error->text);
         break;
     case PARSER_ERROR_UNEXPECTED_TOKEN:
-        sprintf(err->text, "No se esperaba token `%s` en línea %d, columna %d",
-                p->token->text, p->token->line + 1, p->token->column + 1);
+        snprintf(err->text, sizeof(err->text),
+                 "No se esperaba token `%.*s` en línea %d, columna %d",
+                 p->token->length < LEXER_ERROR_TOKEN ? (int) p->token->length
+                                                      : LEXER_ERROR_TOKEN,
+                 p->token->text, p->token->line + 1, p->token->column + 1);
         break;
     case PARSER_ERROR_UNEXPECTED_EOF:
         strcpy(err->text, "No se esperaba fin de archivo");
@@ -38,6 +45,14 @@ ParserError *parser_error_new(Parser *p, ParserErrorType type)
     case PARSER_ERROR_INVALID_SEQUENCE:
         strcpy(err->text, "Secuencia inválida");
         break;
+    case PARSER_ERROR_UNEXPECTED_EOL:
+        snprintf(err->text, sizeof(err->text),
+                 "No se esperaba fin de línea en línea %d, columna %d",
+                 p->token->line + 1, p->token->column + 1);
+        break;
+    case PARSER_ERROR_TOO_LARGE:
+        strcpy(err->text, "La expresión es demasiado grande para el árbol");
+        break;
     }
 
     return err;
@@ -52,16 +67,28 @@ Parser *parser_new(Lexer *lex)
 {
     Parser *p = cmalloc(sizeof(*p));
     p->lex = lex;
+    p->token = NULL;
+    p->batch = token_batch_new(LEXER_BATCH_SIZE);
+    p->terminals = cmalloc(LEXER_BATCH_SIZE * sizeof(*p->terminals));
+    p->batch_next = 0;
+    p->terminal = PARSER_TERMINAL_END;
     p->stack = parser_stack_new();
     p->error = NULL;
     p->beforeproc = NULL;
     p->afterproc = NULL;
+    p->trace = NULL;
+    p->ast = NULL;
+    p->rpn = NULL;
+    p->data = NULL;
+    p->line = 0;
     return p;
 }
 
 void parser_destroy(Parser *p)
 {
     parser_stack_destroy(p->stack);
+    token_batch_destroy(p->batch);
+    cfree(p->terminals);
     if (p->error != NULL) {
         parser_error_destroy(p->error);
     }
@@ -75,16 +102,6 @@ void parser_destroy_all(Parser *p)
     parser_destroy(p);
 }
 
-static int parser_advance(Parser *p)
-{
-    if (p->token != NULL) {
-        lexer_token_destroy(p->token);
-    }
-
-    p->token = lexer_next_token(p->lex);
-    return p->token != NULL;
-}
-
 static void parser_reject(Parser *p)
 {
     // Secuencia rechazada
@@ -95,6 +112,8 @@ static void parser_reject(Parser *p)
         } else {
             err = parser_error_new(p, PARSER_ERROR_UNEXPECTED_EOF);
         }
+    } else if (p->token->type == EXPRESSION_END) {
+        err = parser_error_new(p, PARSER_ERROR_UNEXPECTED_EOL);
     } else {
         err = parser_error_new(p, PARSER_ERROR_UNEXPECTED_TOKEN);
     }
@@ -102,117 +121,216 @@ static void parser_reject(Parser *p)
     p->error = err;
 }
 
-// <A> → <B><A'>
-// Entrada: id | num | "("
-PARSER_PROC(1,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_AP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_B))
+const ParserProduction parser_productions[PARSER_PROC_COUNT] = {
+    [1] = { FALSE, 2, { PARSER_SYMBOL_NONTERM_AP, PARSER_SYMBOL_NONTERM_B } },
+    [2] = { TRUE, 2, { PARSER_SYMBOL_NONTERM_AP, PARSER_SYMBOL_NONTERM_B } },
+    [3] = { FALSE, 0, { 0 } },
+    [4] = { FALSE, 2, { PARSER_SYMBOL_NONTERM_BP, PARSER_SYMBOL_NONTERM_C } },
+    [5] = { TRUE, 2, { PARSER_SYMBOL_NONTERM_BP, PARSER_SYMBOL_NONTERM_C } },
+    [6] = { FALSE, 0, { 0 } },
+    [7] = { FALSE, 2, { PARSER_SYMBOL_NONTERM_CP, PARSER_SYMBOL_NONTERM_D } },
+    [8] = { TRUE, 2, { PARSER_SYMBOL_NONTERM_CP, PARSER_SYMBOL_NONTERM_D } },
+    [9] = { FALSE, 0, { 0 } },
+    [10] = { FALSE, 2, { PARSER_SYMBOL_NONTERM_DP, PARSER_SYMBOL_NONTERM_E } },
+    [11] = { TRUE, 2, { PARSER_SYMBOL_NONTERM_DP, PARSER_SYMBOL_NONTERM_E } },
+    [12] = { FALSE, 0, { 0 } },
+    [13] = { FALSE, 2, { PARSER_SYMBOL_NONTERM_EP, PARSER_SYMBOL_NONTERM_F } },
+    [14] = { TRUE, 2, { PARSER_SYMBOL_NONTERM_EP, PARSER_SYMBOL_NONTERM_F } },
+    [15] = { FALSE, 0, { 0 } },
+    [16] = { TRUE, 0, { 0 } },
+    [17] = { TRUE, 2, { PARSER_SYMBOL_TERM_RP, PARSER_SYMBOL_NONTERM_A } },
+    [18] = { TRUE, 0, { 0 } },
+};
 
-// <A'> → <OL><B><A'>
-// Entrada: "&" | "|"
-PARSER_PROC(2,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_AP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_B);
-    parser_advance(p))
+#ifndef PARSER_NO_TRACE
+static const char *const parser_proc_names[] = {
+    "", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+    "10", "11", "12", "13", "14", "15", "16", "17", "18",
+};
+#endif
+
+#define R PARSER_PROC_REJECT
+
+// Símbolo de pila × terminal → producción
+static const uint8_t
+parser_table[PARSER_SYMBOL_COUNT][PARSER_TERMINAL_COUNT] = {
+    //                           id|num  (   )   OA1 OA2 OA3 OR  OL  ¬
+    [PARSER_SYMBOL_BOTTOM]    = { R,     R,  R,  R,  R,  R,  R,  R,  PARSER_PROC_ACCEPT },
+    [PARSER_SYMBOL_NONTERM_A] = { 1,     1,  R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_NONTERM_AP]= { R,     R,  3,  R,  R,  R,  R,  2,  3 },
+    [PARSER_SYMBOL_NONTERM_B] = { 4,     4,  R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_NONTERM_BP]= { R,     R,  6,  R,  R,  R,  5,  6,  6 },
+    [PARSER_SYMBOL_NONTERM_C] = { 7,     7,  R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_NONTERM_CP]= { R,     R,  9,  8,  R,  R,  9,  9,  9 },
+    [PARSER_SYMBOL_NONTERM_D] = { 10,    10, R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_NONTERM_DP]= { R,     R,  12, 12, 11, R,  12, 12, 12 },
+    [PARSER_SYMBOL_NONTERM_E] = { 13,    13, R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_NONTERM_EP]= { R,     R,  15, 15, 15, 14, 15, 15, 15 },
+    [PARSER_SYMBOL_NONTERM_F] = { 16,    17, R,  R,  R,  R,  R,  R,  R },
+    [PARSER_SYMBOL_TERM_RP]   = { R,     R,  18, R,  R,  R,  R,  R,  R },
+};
 
-// <A'> → ε
-// Entrada: ")" | ¬
-PARSER_PROC(3, parser_stack_pop(p->stack, NULL))
+#undef R
 
-// <B> → <C><B'>
-// Entrada: id | num | "("
-PARSER_PROC(4,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_BP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_C))
+static const uint8_t parser_type_terminals[] = {
+    [NUMBER] = PARSER_TERMINAL_OPERAND,
+    [IDENTIFIER] = PARSER_TERMINAL_OPERAND,
+    [PAREN_LEFT] = PARSER_TERMINAL_PL,
+    [PAREN_RIGHT] = PARSER_TERMINAL_PR,
+    [EXPRESSION_END] = PARSER_TERMINAL_END,
+};
 
-// <B'> → <OR><C><B'>
-// Entrada: "=" | "<" | "<=" | ">" | ">="
-PARSER_PROC(5,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_BP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_C);
-    parser_advance(p))
+static const uint8_t parser_operator_terminals[] = {
+    [OPERATOR_PLUS] = PARSER_TERMINAL_OA1,
+    [OPERATOR_MINUS] = PARSER_TERMINAL_OA1,
+    [OPERATOR_MUL] = PARSER_TERMINAL_OA2,
+    [OPERATOR_DIV] = PARSER_TERMINAL_OA2,
+    [OPERATOR_POW] = PARSER_TERMINAL_OA3,
+    [OPERATOR_EQ] = PARSER_TERMINAL_OR,
+    [OPERATOR_LT] = PARSER_TERMINAL_OR,
+    [OPERATOR_LE] = PARSER_TERMINAL_OR,
+    [OPERATOR_GT] = PARSER_TERMINAL_OR,
+    [OPERATOR_GE] = PARSER_TERMINAL_OR,
+    [OPERATOR_AND] = PARSER_TERMINAL_OL,
+    [OPERATOR_OR] = PARSER_TERMINAL_OL,
+};
 
-// <B'> → ε
-// Entrada: <OL> | ")" | ¬
-PARSER_PROC(6, parser_stack_pop(p->stack, NULL))
+// Terminal de cada token del lote, en un bucle sin saltos
+static void parser_classify(Parser *p)
+{
+    TokenBatch *batch = p->batch;
+    for (size_t i = 0; i < batch->count; i++) {
+        uint8_t op = batch->op[i];
+        p->terminals[i] = op != OPERATOR_NONE ? parser_operator_terminals[op]
+                                              : parser_type_terminals[
+                                                    batch->type[i]];
+    }
+}
 
-// <C> → <D><C'>
-// Entrada: id | num | "("
-PARSER_PROC(7,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_CP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_D))
+// Los tokens se piden al lexer por lotes y se consumen por índice. p->token
+// apunta a una copia del token actual para los mensajes y los callbacks.
+static int parser_advance(Parser *p)
+{
+    TokenBatch *batch = p->batch;
+    if (p->batch_next == batch->count) {
+        p->batch_next = 0;
+        if (lexer_next_tokens(p->lex, batch, batch->capacity) == 0) {
+            p->token = NULL;
+            p->terminal = PARSER_TERMINAL_END;
+            return FALSE;
+        }
 
-// <C'> → <OA1><D><C'>
-// Entrada: "+" | "-"
-PARSER_PROC(8,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_CP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_D);
-    parser_advance(p))
+        parser_classify(p);
+    }
 
-// <C'> → ε
-// Entrada: <OR> | <OL> | ")" | ¬
-PARSER_PROC(9, parser_stack_pop(p->stack, NULL))
+    size_t i = p->batch_next++;
+    Token *t = &p->current;
+    t->type = batch->type[i];
+    t->op = batch->op[i];
+    t->text = batch->text[i];
+    t->offset = batch->offset[i];
+    t->length = batch->length[i];
+    t->line = batch->line[i];
+    t->column = batch->column[i];
+    t->value = batch->value[i];
+    p->token = t;
+    p->terminal = p->terminals[i];
+    return TRUE;
+}
 
-// <D> → <E><D'>
-// Entrada: id | num | "("
-PARSER_PROC(10,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_DP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_E))
+// Lleva al árbol y a la postfija el token que consume la producción proc
+static void parser_build(Parser *p, int proc)
+{
+    Ast *ast = p->ast;
+    Rpn *rpn = p->rpn;
+    switch (proc) {
+    case 16:
+        if (ast != NULL) {
+            ast_leaf(ast, p->token);
+        }
 
-// <D'> → <OA2><E><D'>
-// Entrada: "*" | "/"
-PARSER_PROC(11,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_DP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_E);
-    parser_advance(p))
+        if (rpn != NULL) {
+            rpn_operand(rpn, p->token);
+        }
 
-// <D'> → ε
-// Entrada: <OA1> | <OR> | <OL> | ")" | ¬
-PARSER_PROC(12, parser_stack_pop(p->stack, NULL))
+        break;
+    case 17:
+        if (ast != NULL) {
+            ast_open(ast);
+        }
 
-// <E> → <F><E'>
-// Entrada: id | num | "("
-PARSER_PROC(13,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_EP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_F))
+        if (rpn != NULL) {
+            rpn_open(rpn);
+        }
 
-// <E'> → <OA3><F><E'>
-// Entrada: "^"
-PARSER_PROC(14,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_EP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_F);
-    parser_advance(p))
+        break;
+    case 18:
+        if (ast != NULL) {
+            ast_close(ast);
+        }
 
-// <E'> → ε
-// Entrada: <OA2> | <OA1> | <OR> | <OL> | ")" | ¬
-PARSER_PROC(15, parser_stack_pop(p->stack, NULL))
+        if (rpn != NULL) {
+            rpn_close(rpn);
+        }
 
-// <F> → id | num
-PARSER_PROC(16,
-    parser_stack_pop(p->stack, NULL);
-    parser_advance(p))
+        break;
+    default:
+        if (ast != NULL) {
+            ast_operator(ast, p->token->op);
+        }
 
-// <F> → "(" <A> ")"
-PARSER_PROC(17,
-    parser_stack_pop(p->stack, NULL);
-    parser_stack_push(p->stack, PARSER_SYMBOL_TERM_RP);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_A);
-    parser_advance(p))
+        if (rpn != NULL) {
+            rpn_operator(rpn, p->token->op);
+        }
+
+        break;
+    }
+}
+
+// Antes de analizar una expresión
+static void parser_build_reset(Parser *p)
+{
+    if (p->ast != NULL) {
+        ast_reset(p->ast);
+    }
+
+    if (p->rpn != NULL) {
+        rpn_reset(p->rpn);
+    }
+}
 
-// Símbolo de pila: "("
-PARSER_PROC(18,
+// Al aceptar la expresión; si el árbol no cabe, se rechaza
+static void parser_build_finish(Parser *p)
+{
+    if (p->ast != NULL) {
+        ast_finish(p->ast);
+        if (p->ast->overflow) {
+            p->error = parser_error_new(p, PARSER_ERROR_TOO_LARGE);
+            return;
+        }
+    }
+
+    if (p->rpn != NULL) {
+        rpn_finish(p->rpn);
+    }
+}
+
+static void parser_apply(Parser *p, int proc)
+{
+    const ParserProduction *prod = &parser_productions[proc];
     parser_stack_pop(p->stack, NULL);
-    parser_advance(p));
+    for (int i = 0; i < prod->count; i++) {
+        parser_stack_push(p->stack, prod->push[i]);
+    }
+
+    if (prod->consume) {
+        if (p->ast != NULL || p->rpn != NULL) {
+            parser_build(p, proc);
+        }
+
+        parser_advance(p);
+    }
+}
 
 /*
  * Gramática:
@@ -221,7 +339,7 @@ PARSER_PROC(18,
  * <A'>  → ε
  * <OL>  → "&" | "|"
  * <B>   → <C><B'>
- * <B'>  → <OR><C>
+ * <B'>  → <OR><C><B'>
  * <B'>  → ε
  * <OR>  → "=" | "<" | "<=" | ">" | ">="
  * <C>   → <D><C'>
@@ -239,12 +357,18 @@ PARSER_PROC(18,
  * <F>   → id
  * <F>   → num
  * <F>   → "(" <A> ")"
+ *
+ * El análisis se guía por parser_table. La traza binaria y los callbacks
+ * beforeproc/afterproc solo se atienden si alguno está definido, y nunca si
+ * se compila con PARSER_NO_TRACE. Con p->ast o p->rpn, cada token consumido
+ * se lleva al árbol o a la postfija, que se completan al aceptar.
  */
-void parser_parse(Parser *p)
+static void parser_run(Parser *p)
 {
-    parser_stack_push(p->stack, PARSER_SYMBOL_BOTTOM);
-    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_A);
-    parser_advance(p);
+#ifndef PARSER_NO_TRACE
+    int traced = p->beforeproc != NULL || p->afterproc != NULL ||
+                 p->trace != NULL;
+#endif
 
     while (TRUE) {
         if (p->lex->error != NULL) {
@@ -252,269 +376,111 @@ void parser_parse(Parser *p)
             return;
         }
 
-        int stack_top = *parser_stack_top(p->stack);
-        switch (stack_top) {
-        case PARSER_SYMBOL_BOTTOM:
-            // Rechazar si aún queda un token
-            if (p->token != NULL) {
-                parser_reject(p);
-            }
-
+        uint8_t top = *parser_stack_top(p->stack);
+        int proc = parser_table[top][p->terminal];
+        if (proc == PARSER_PROC_REJECT) {
+            parser_reject(p);
+            return;
+        } else if (proc == PARSER_PROC_ACCEPT) {
             // Finalizar análisis sintáctico
+            parser_build_finish(p);
             return;
-        case PARSER_SYMBOL_NONTERM_A:
-            if (p->token == NULL) {
-                parser_reject(p);
-                return;
-            }
-
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-            case PAREN_LEFT:
-                parser_proc1(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
-
-            break;
-        case PARSER_SYMBOL_NONTERM_AP:
-            if (p->token == NULL) {
-                parser_proc3(p);
-                break;
-            }
-
-            switch (p->token->type) {
-            case OPERATOR_LOGICAL:
-                parser_proc2(p);
-                break;
-            case PAREN_RIGHT:
-                parser_proc3(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
-
-            break;
-        case PARSER_SYMBOL_NONTERM_B:
-            if (p->token == NULL) {
-                parser_reject(p);
-                return;
-            }
-
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-            case PAREN_LEFT:
-                parser_proc4(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
-
-            break;
-        case PARSER_SYMBOL_NONTERM_BP:
-            if (p->token == NULL) {
-                parser_proc6(p);
-                break;
-            }
-
-            switch (p->token->type) {
-            case OPERATOR_RELATIONAL:
-                parser_proc5(p);
-                break;
-            case OPERATOR_LOGICAL:
-            case PAREN_RIGHT:
-                parser_proc6(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+        }
 
-            break;
-        case PARSER_SYMBOL_NONTERM_C:
-            if (p->token == NULL) {
-                parser_reject(p);
-                return;
+#ifndef PARSER_NO_TRACE
+        if (traced) {
+            if (p->trace != NULL) {
+                parser_trace_record(p->trace, proc,
+                                    parser_productions[proc].count - 1,
+                                    p->token);
             }
 
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-            case PAREN_LEFT:
-                parser_proc7(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
+            if (p->beforeproc != NULL) {
+                p->beforeproc(parser_proc_names[proc], p);
             }
 
-            break;
-        case PARSER_SYMBOL_NONTERM_CP:
-            if (p->token == NULL) {
-                parser_proc9(p);
-                break;
+            parser_apply(p, proc);
+            if (p->afterproc != NULL) {
+                p->afterproc(parser_proc_names[proc], p);
             }
 
-            switch (p->token->type) {
-            case OPERATOR_ARITHMETIC:
-                if (strcmp(p->token->text, "+") == 0 ||
-                    strcmp(p->token->text, "-") == 0)
-                {
-                    parser_proc8(p);
-                } else {
-                    parser_reject(p);
-                    return;
-                }
-
-                break;
-            case OPERATOR_RELATIONAL:
-            case OPERATOR_LOGICAL:
-            case PAREN_RIGHT:
-                parser_proc9(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
-
-            break;
-        case PARSER_SYMBOL_NONTERM_D:
-            if (p->token == NULL) {
-                parser_reject(p);
-                return;
-            }
+            continue;
+        }
+#endif
 
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-            case PAREN_LEFT:
-                parser_proc10(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+        parser_apply(p, proc);
+    }
+}
 
-            break;
-        case PARSER_SYMBOL_NONTERM_DP:
-            if (p->token == NULL) {
-                parser_proc12(p);
-                break;
-            }
+void parser_parse(Parser *p)
+{
+    parser_stack_push(p->stack, PARSER_SYMBOL_BOTTOM);
+    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_A);
+    parser_build_reset(p);
+    parser_advance(p);
+    parser_run(p);
+}
 
-            switch (p->token->type) {
-            case OPERATOR_ARITHMETIC:
-                if (strcmp(p->token->text, "*") == 0 ||
-                    strcmp(p->token->text, "/") == 0)
-                {
-                    parser_proc11(p);
-                } else if (strcmp(p->token->text, "+") == 0 ||
-                           strcmp(p->token->text, "-") == 0)
-                {
-                    parser_proc12(p);
-                } else {
-                    parser_reject(p);
-                    return;
-                }
-
-                break;
-            case OPERATOR_RELATIONAL:
-            case OPERATOR_LOGICAL:
-            case PAREN_RIGHT:
-                parser_proc12(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+static int parser_at_end(Parser *p)
+{
+    return p->token != NULL && p->token->type == EXPRESSION_END;
+}
 
-            break;
-        case PARSER_SYMBOL_NONTERM_E:
-            if (p->token == NULL) {
-                parser_reject(p);
+// Tras un error se descarta el resto de la línea, incluidos otros errores
+// léxicos, hasta el siguiente EXPRESSION_END o el fin de la entrada
+static void parser_resync(Parser *p)
+{
+    while (!parser_at_end(p)) {
+        if (p->token == NULL) {
+            if (p->lex->error == NULL) {
                 return;
             }
 
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-            case PAREN_LEFT:
-                parser_proc13(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+            lexer_error_destroy(p->lex->error);
+            p->lex->error = NULL;
+        }
 
-            break;
-        case PARSER_SYMBOL_NONTERM_EP:
-            if (p->token == NULL) {
-                parser_proc15(p);
-                break;
-            }
+        parser_advance(p);
+    }
+}
 
-            switch (p->token->type) {
-            case OPERATOR_ARITHMETIC:
-                if (strcmp(p->token->text, "^") == 0) {
-                    parser_proc14(p);
-                } else if (strcmp(p->token->text, "+") == 0 ||
-                           strcmp(p->token->text, "-") == 0 ||
-                           strcmp(p->token->text, "*") == 0 ||
-                           strcmp(p->token->text, "/") == 0)
-                {
-                    parser_proc15(p);
-                } else {
-                    parser_reject(p);
-                    return;
-                }
-
-                break;
-            case OPERATOR_RELATIONAL:
-            case OPERATOR_LOGICAL:
-            case PAREN_RIGHT:
-                parser_proc15(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+/*
+ * Modo por líneas (lex->lines): analiza la siguiente expresión de la entrada
+ * hasta su EXPRESSION_END, sin consumirlo para no leer la línea siguiente
+ * antes de tiempo. Las líneas vacías se saltan. Devuelve FALSE si no quedan
+ * expresiones; si no, p->line indica la línea de la expresión y p->error su
+ * veredicto.
+ */
+int parser_parse_next(Parser *p)
+{
+    if (p->error != NULL) {
+        parser_error_destroy(p->error);
+        p->error = NULL;
+    }
 
-            break;
-        case PARSER_SYMBOL_NONTERM_F:
-            if (p->token == NULL) {
-                parser_reject(p);
-                return;
-            }
+    do {
+        parser_advance(p);
+    } while (parser_at_end(p));
 
-            switch (p->token->type) {
-            case IDENTIFIER:
-            case NUMBER:
-                parser_proc16(p);
-                break;
-            case PAREN_LEFT:
-                parser_proc17(p);
-                break;
-            default:
-                parser_reject(p);
-                return;
-            }
+    if (p->token == NULL && p->lex->error == NULL) {
+        return FALSE;
+    }
 
-            break;
-        case PARSER_SYMBOL_TERM_RP:
-            if (p->token != NULL && p->token->type == PAREN_RIGHT) {
-                parser_proc18(p);
-            } else {
-                parser_reject(p);
-                return;
-            }
+    p->line = p->token != NULL ? p->token->line : p->lex->error->line;
+#ifndef PARSER_NO_TRACE
+    if (p->trace != NULL) {
+        parser_trace_reset(p->trace);
+    }
+#endif
 
-            break;
-        }
+    parser_stack_clear(p->stack);
+    parser_stack_push(p->stack, PARSER_SYMBOL_BOTTOM);
+    parser_stack_push(p->stack, PARSER_SYMBOL_NONTERM_A);
+    parser_build_reset(p);
+    parser_run(p);
+    if (p->error != NULL) {
+        parser_resync(p);
     }
+
+    return TRUE;
 }
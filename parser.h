@@ -1,27 +1,49 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "ast.h"
+#include "rpn.h"
 #include "stack.h"
 #include "lexer.h"
+#include "trace.h"
 
-// Estructura general de un procedimiento del parser
-#define PARSER_PROC(name, definition) \
-    static void parser_proc##name(Parser *p) \
-    { \
-        if (p->beforeproc != NULL) { \
-            p->beforeproc(#name, p); \
-        } \
-        definition; \
-        if (p->afterproc != NULL) { \
-            p->afterproc(#name, p); \
-        } \
-    }
+enum ParserStackSymbols {
+    PARSER_SYMBOL_BOTTOM,           // Fondo de pila
+    PARSER_SYMBOL_NONTERM_A,        // <A> (Axioma)
+    PARSER_SYMBOL_NONTERM_AP,       // <A'>
+    PARSER_SYMBOL_NONTERM_B,        // <B>
+    PARSER_SYMBOL_NONTERM_BP,       // <B'>
+    PARSER_SYMBOL_NONTERM_C,        // <C>
+    PARSER_SYMBOL_NONTERM_CP,       // <C'>
+    PARSER_SYMBOL_NONTERM_D,        // <D>
+    PARSER_SYMBOL_NONTERM_DP,       // <D'>
+    PARSER_SYMBOL_NONTERM_E,        // <E>
+    PARSER_SYMBOL_NONTERM_EP,       // <E'>
+    PARSER_SYMBOL_NONTERM_F,        // <F>
+    PARSER_SYMBOL_TERM_RP,          // ")"
+    PARSER_SYMBOL_COUNT,
+};
+
+// Producciones, numeradas del 1 al 18 como en la gramática. Cada una desapila
+// el símbolo de la cima, apila push[0..count) (el último queda en la cima) y,
+// si empieza por un terminal, consume el token actual.
+#define PARSER_PROC_COUNT 19
+
+typedef struct {
+    uint8_t consume;
+    uint8_t count;
+    uint8_t push[2];
+} ParserProduction;
+
+extern const ParserProduction parser_productions[PARSER_PROC_COUNT];
 
 typedef enum {
     PARSER_ERROR_LEXER_ERROR,
     PARSER_ERROR_UNEXPECTED_TOKEN,
     PARSER_ERROR_UNEXPECTED_EOF,
     PARSER_ERROR_INVALID_SEQUENCE,
+    PARSER_ERROR_UNEXPECTED_EOL,
+    PARSER_ERROR_TOO_LARGE,
 } ParserErrorType;
 
 typedef struct {
@@ -34,10 +56,20 @@ typedef void (*ParserProcCallback)(const char*, struct Parser*);
 typedef struct Parser {
     Lexer *lex;
     Token *token;
+    TokenBatch *batch;
+    uint8_t *terminals;     // Terminal de cada token del lote
+    size_t batch_next;      // Siguiente token del lote
+    int terminal;           // Terminal del token actual
+    Token current;
     ParserStack *stack;
     ParserError *error;
     ParserProcCallback beforeproc;
     ParserProcCallback afterproc;
+    ParserTrace *trace;
+    Ast *ast;               // Si no es NULL, recibe el árbol de la expresión
+    Rpn *rpn;               // Si no es NULL, recibe la expresión en postfija
+    void *data;             // Datos propios de los callbacks
+    int line;               // Línea de la expresión (parser_parse_next)
 } Parser;
 
 ParserError *parser_error_new(Parser *p, ParserErrorType type);
@@ -46,5 +78,6 @@ Parser *parser_new(Lexer *lex);
 void parser_destroy(Parser *p);
 void parser_destroy_all(Parser *p);
 void parser_parse(Parser *p);
+int parser_parse_next(Parser *p);
 
 #endif
@@ -0,0 +1,217 @@
+#include "rpn.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cdefs.h"
+#include "cmem.h"
+
+#define RPN_INITIAL_CAPACITY 64
+
+Rpn *rpn_new(void)
+{
+    Rpn *rpn = cmalloc(sizeof(*rpn));
+    rpn->code = NULL;
+    rpn->count = 0;
+    rpn->capacity = 0;
+    rpn->numbers = NULL;
+    rpn->number_count = 0;
+    rpn->number_capacity = 0;
+    rpn->names = NULL;
+    rpn->name_count = 0;
+    rpn->name_capacity = 0;
+    rpn->text = NULL;
+    rpn->text_size = 0;
+    rpn->text_capacity = 0;
+    rpn->name_table_size = RPN_INITIAL_CAPACITY;
+    rpn->name_table = ccalloc(rpn->name_table_size,
+                              sizeof(*rpn->name_table));
+    rpn->operators.data = NULL;
+    rpn->operators.count = 0;
+    rpn->operators.capacity = 0;
+    rpn->complete = FALSE;
+    return rpn;
+}
+
+void rpn_destroy(Rpn *rpn)
+{
+    cfree(rpn->code);
+    cfree(rpn->numbers);
+    cfree(rpn->names);
+    cfree(rpn->text);
+    cfree(rpn->name_table);
+    cfree(rpn->operators.data);
+    cfree(rpn);
+}
+
+void rpn_reset(Rpn *rpn)
+{
+    if (rpn->name_count > 0) {
+        memset(rpn->name_table, 0,
+               rpn->name_table_size * sizeof(*rpn->name_table));
+    }
+
+    rpn->count = 0;
+    rpn->number_count = 0;
+    rpn->name_count = 0;
+    rpn->text_size = 0;
+    rpn->operators.count = 0;
+    rpn->complete = FALSE;
+}
+
+static void rpn_emit(Rpn *rpn, RpnKind kind, TokenOperator op, uint32_t arg)
+{
+    if (rpn->count == rpn->capacity) {
+        rpn->code = creserve(rpn->code, &rpn->capacity, rpn->count + 1,
+                             sizeof(*rpn->code));
+    }
+
+    RpnInstruction *ins = &rpn->code[rpn->count++];
+    ins->kind = (uint8_t) kind;
+    ins->op = (uint8_t) op;
+    ins->arg = arg;
+}
+
+// FNV-1a
+static uint32_t rpn_hash(const char *name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Hueco de name en la tabla: el que lo contiene o el vacío donde iría
+static uint32_t *rpn_name_slot(const Rpn *rpn, const char *name,
+                               size_t length)
+{
+    uint32_t mask = rpn->name_table_size - 1;
+    uint32_t i = rpn_hash(name, length) & mask;
+    while (rpn->name_table[i] != 0) {
+        const RpnName *n = &rpn->names[rpn->name_table[i] - 1];
+        if (n->length == length &&
+            memcmp(rpn->text + n->offset, name, length) == 0)
+        {
+            break;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return &rpn->name_table[i];
+}
+
+// Duplica la tabla de nombres cuando se llena a la mitad
+static void rpn_grow_names(Rpn *rpn)
+{
+    cfree(rpn->name_table);
+    rpn->name_table_size *= 2;
+    rpn->name_table = ccalloc(rpn->name_table_size,
+                              sizeof(*rpn->name_table));
+    for (uint32_t i = 0; i < rpn->name_count; i++) {
+        const RpnName *n = &rpn->names[i];
+        *rpn_name_slot(rpn, rpn->text + n->offset, n->length) = i + 1;
+    }
+}
+
+uint32_t rpn_find_name(const Rpn *rpn, const char *name, size_t length)
+{
+    uint32_t slot = *rpn_name_slot(rpn, name, length);
+    return slot != 0 ? slot - 1 : RPN_NONE;
+}
+
+static uint32_t rpn_add_name(Rpn *rpn, const char *name, size_t length)
+{
+    uint32_t *slot = rpn_name_slot(rpn, name, length);
+    if (*slot != 0) {
+        return *slot - 1;
+    }
+
+    rpn->text = creserve(rpn->text, &rpn->text_capacity,
+                         rpn->text_size + length, 1);
+    memcpy(rpn->text + rpn->text_size, name, length);
+    rpn->names = creserve(rpn->names, &rpn->name_capacity,
+                          rpn->name_count + 1, sizeof(*rpn->names));
+    RpnName *n = &rpn->names[rpn->name_count];
+    n->offset = (uint32_t) rpn->text_size;
+    n->length = (uint32_t) length;
+    rpn->text_size += length;
+    *slot = ++rpn->name_count;
+
+    if (rpn->name_count * 2 >= rpn->name_table_size) {
+        rpn_grow_names(rpn);
+    }
+
+    return rpn->name_count - 1;
+}
+
+void rpn_operand(Rpn *rpn, const Token *t)
+{
+    if (t->type == NUMBER) {
+        rpn->numbers = creserve(rpn->numbers, &rpn->number_capacity,
+                                rpn->number_count + 1,
+                                sizeof(*rpn->numbers));
+        rpn->numbers[rpn->number_count] = t->value;
+        rpn_emit(rpn, RPN_NUMBER, OPERATOR_NONE, rpn->number_count++);
+    } else {
+        rpn_emit(rpn, RPN_IDENTIFIER, OPERATOR_NONE,
+                 rpn_add_name(rpn, t->text, t->length));
+    }
+}
+
+// En postfija reducir es escribir el operador retirado
+static void rpn_reduce(void *builder, TokenOperator op)
+{
+    rpn_emit(builder, RPN_OPERATOR, op, 0);
+}
+
+void rpn_operator(Rpn *rpn, TokenOperator op)
+{
+    ast_operators_shift(&rpn->operators, op, rpn_reduce, rpn);
+}
+
+void rpn_open(Rpn *rpn)
+{
+    ast_operators_push(&rpn->operators, OPERATOR_NONE);
+}
+
+void rpn_close(Rpn *rpn)
+{
+    ast_operators_close(&rpn->operators, rpn_reduce, rpn);
+}
+
+void rpn_finish(Rpn *rpn)
+{
+    ast_operators_finish(&rpn->operators, rpn_reduce, rpn);
+    rpn->complete = TRUE;
+}
+
+// Texto más corto (15 o 17 cifras) del que se recupera el mismo valor
+void rpn_format_number(char *text, double value)
+{
+    snprintf(text, RPN_NUMBER_TEXT, "%.15g", value);
+    if (strtod(text, NULL) != value) {
+        snprintf(text, RPN_NUMBER_TEXT, "%.17g", value);
+    }
+}
+
+void rpn_print(const Rpn *rpn, FILE *out)
+{
+    for (uint32_t i = 0; i < rpn->count; i++) {
+        const RpnInstruction *ins = &rpn->code[i];
+        if (i > 0) {
+            fputc(' ', out);
+        }
+
+        if (ins->kind == RPN_NUMBER) {
+            char number[RPN_NUMBER_TEXT];
+            rpn_format_number(number, rpn->numbers[ins->arg]);
+            fputs(number, out);
+        } else if (ins->kind == RPN_IDENTIFIER) {
+            const RpnName *n = &rpn->names[ins->arg];
+            fwrite(rpn->text + n->offset, 1, n->length, out);
+        } else {
+            fputs(ast_operator_text(ins->op), out);
+        }
+    }
+}
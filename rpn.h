@@ -0,0 +1,70 @@
+#ifndef RPN_H
+#define RPN_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "lexer.h"
+
+// Identificador que no aparece en la expresión
+#define RPN_NONE UINT32_MAX
+
+// Tamaño del texto de rpn_format_number
+#define RPN_NUMBER_TEXT 32
+
+typedef enum {
+    RPN_NUMBER,             // Apila numbers[arg]
+    RPN_IDENTIFIER,         // Apila el valor del identificador arg
+    RPN_OPERATOR,           // Aplica op a los dos últimos valores
+} RpnKind;
+
+typedef struct {
+    uint8_t kind;           // RpnKind
+    uint8_t op;             // TokenOperator de RPN_OPERATOR
+    uint32_t arg;
+} RpnInstruction;
+
+typedef struct {
+    uint32_t offset;        // Posición del nombre en Rpn.text
+    uint32_t length;
+} RpnName;
+
+/*
+ * Expresión en notación postfija: un arreglo de instrucciones y dos tablas,
+ * la de constantes numéricas y la de identificadores distintos (cada nombre
+ * aparece una sola vez, así que su índice sirve para asociarle un valor).
+ * Como en Ast, rpn_reset vacía todo sin liberar la memoria.
+ */
+typedef struct {
+    RpnInstruction *code;
+    uint32_t count;
+    size_t capacity;
+    double *numbers;
+    uint32_t number_count;
+    size_t number_capacity;
+    RpnName *names;
+    uint32_t name_count;
+    size_t name_capacity;
+    char *text;
+    size_t text_size;
+    size_t text_capacity;
+    uint32_t *name_table;   // Índices de names + 1 por hash del nombre
+    uint32_t name_table_size;
+    AstOperators operators; // Pendientes durante la construcción
+    int complete;           // La expresión se aceptó
+} Rpn;
+
+Rpn *rpn_new(void);
+void rpn_destroy(Rpn *rpn);
+void rpn_reset(Rpn *rpn);
+void rpn_operand(Rpn *rpn, const Token *t);
+void rpn_operator(Rpn *rpn, TokenOperator op);
+void rpn_open(Rpn *rpn);
+void rpn_close(Rpn *rpn);
+void rpn_finish(Rpn *rpn);
+uint32_t rpn_find_name(const Rpn *rpn, const char *name, size_t length);
+void rpn_format_number(char *text, double value);
+void rpn_print(const Rpn *rpn, FILE *out);
+
+#endif
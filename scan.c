@@ -0,0 +1,329 @@
+#include "scan.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#define SCAN_SPACE 1
+#define SCAN_WORD 2
+#define SCAN_DIGIT 4
+#define SCAN_NEWLINE 8
+#define SCAN_OPERATOR 16
+
+#define S SCAN_SPACE
+#define N SCAN_NEWLINE
+#define W SCAN_WORD
+#define D (SCAN_WORD | SCAN_DIGIT)
+#define O SCAN_OPERATOR
+
+static const unsigned char scan_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, N, S, S, N, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    S, 0, 0, 0, 0, 0, O, 0, O, O, O, O, 0, O, 0, O,
+    D, D, D, D, D, D, D, D, D, D, 0, 0, O, O, O, 0,
+    0, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, 0, 0, 0, O, W,
+    0, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, 0, O, 0, 0, 0,
+};
+
+#undef S
+#undef N
+#undef W
+#undef D
+#undef O
+
+// Máscaras de un bloque de 64 bytes: espacios (incluidos saltos de línea),
+// saltos de línea y operadores o paréntesis
+typedef struct {
+    uint64_t space;
+    uint64_t newline;
+    uint64_t op;
+} ScanMasks;
+
+typedef struct {
+    uint64_t space;
+    uint64_t op;
+} ScanCarry;
+
+static inline uint64_t scan_index_starts(ScanMasks m, ScanCarry *carry)
+{
+    uint64_t after_space = m.space << 1 | carry->space;
+    uint64_t after_op = m.op << 1 | carry->op;
+    carry->space = m.space >> 63;
+    carry->op = m.op >> 63;
+    return ~m.space & (after_space | m.op | after_op);
+}
+
+// Recorre la entrada en bloques de 64 bytes; el último se completa con
+// espacios, que nunca inician un token
+#define SCAN_INDEX(name) \
+    static void scan_index_##name(const char *data, size_t size, \
+                                  uint64_t *starts, uint64_t *newlines) \
+    { \
+        ScanCarry carry = { 1, 0 }; \
+        ScanMasks m; \
+        size_t i; \
+        for (i = 0; size - i >= 64; i += 64) { \
+            m = scan_masks_##name(data + i); \
+            *starts++ = scan_index_starts(m, &carry); \
+            *newlines++ = m.newline; \
+        } \
+        if (i < size) { \
+            char tail[64]; \
+            memset(tail, ' ', sizeof(tail)); \
+            memcpy(tail, data + i, size - i); \
+            m = scan_masks_##name(tail); \
+            *starts = scan_index_starts(m, &carry); \
+            *newlines = m.newline; \
+        } \
+    }
+
+static inline ScanMasks scan_masks_scalar(const char *data)
+{
+    ScanMasks m = { 0, 0, 0 };
+    for (int i = 0; i < 64; i++) {
+        unsigned char cls = scan_classes[(unsigned char) data[i]];
+        uint64_t bit = (uint64_t) 1 << i;
+        if (cls & (SCAN_SPACE | SCAN_NEWLINE)) {
+            m.space |= bit;
+        }
+
+        if (cls & SCAN_NEWLINE) {
+            m.newline |= bit;
+        }
+
+        if (cls & SCAN_OPERATOR) {
+            m.op |= bit;
+        }
+    }
+
+    return m;
+}
+
+SCAN_INDEX(scalar)
+
+static inline const char *scan_scalar(const char *ptr, const char *end,
+                                      unsigned char cls)
+{
+    while (ptr != end && (scan_classes[(unsigned char) *ptr] & cls)) {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+static const char *scan_space_scalar(const char *ptr, const char *end)
+{
+    return scan_scalar(ptr, end, SCAN_SPACE);
+}
+
+static const char *scan_word_scalar(const char *ptr, const char *end)
+{
+    return scan_scalar(ptr, end, SCAN_WORD);
+}
+
+static const char *scan_digits_scalar(const char *ptr, const char *end)
+{
+    return scan_scalar(ptr, end, SCAN_DIGIT);
+}
+
+static const ScanKernels scan_kernels_scalar = {
+    scan_space_scalar,
+    scan_word_scalar,
+    scan_digits_scalar,
+    scan_index_scalar,
+};
+
+#ifdef SCAN_HAVE_X86
+
+// Comparación sin signo lo <= x <= hi con aritmética con signo: se desplaza el
+// rango para que comience en -128
+#define SCAN_RANGE_SSE2(v, lo, hi) \
+    _mm_cmplt_epi8(_mm_add_epi8((v), _mm_set1_epi8((char) (-128 - (lo)))), \
+                   _mm_set1_epi8((char) (-128 + (hi) - (lo) + 1)))
+
+#define SCAN_RANGE_AVX2(v, lo, hi) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + (hi) - (lo) + 1)), \
+                      _mm256_add_epi8((v), \
+                                      _mm256_set1_epi8((char) (-128 - (lo)))))
+
+__attribute__((target("sse2")))
+static inline __m128i scan_space_sse2_mask(__m128i v)
+{
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\v')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i scan_word_sse2_mask(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i m = SCAN_RANGE_SSE2(v, '0', '9');
+    m = _mm_or_si128(m, SCAN_RANGE_SSE2(lower, 'a', 'z'));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i scan_digits_sse2_mask(__m128i v)
+{
+    return SCAN_RANGE_SSE2(v, '0', '9');
+}
+
+#define SCAN_SSE2(name) \
+    __attribute__((target("sse2"))) \
+    static const char *scan_##name##_sse2(const char *ptr, const char *end) \
+    { \
+        while (end - ptr >= 16) { \
+            __m128i v = _mm_loadu_si128((const __m128i*) ptr); \
+            unsigned mask = _mm_movemask_epi8(scan_##name##_sse2_mask(v)); \
+            if (mask != 0xffff) { \
+                return ptr + __builtin_ctz(~mask); \
+            } \
+            ptr += 16; \
+        } \
+        return scan_##name##_scalar(ptr, end); \
+    }
+
+SCAN_SSE2(space)
+SCAN_SSE2(word)
+SCAN_SSE2(digits)
+
+__attribute__((target("sse2")))
+static inline ScanMasks scan_masks_sse2(const char *data)
+{
+    ScanMasks m = { 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*) data + i);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     SCAN_RANGE_SSE2(v, '\t', '\r'));
+        __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        __m128i op = _mm_or_si128(SCAN_RANGE_SSE2(v, '(', '+'),
+                                  SCAN_RANGE_SSE2(v, '<', '>'));
+        op = _mm_or_si128(op, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+        op = _mm_or_si128(op, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        op = _mm_or_si128(op, _mm_cmpeq_epi8(v, _mm_set1_epi8('^')));
+        op = _mm_or_si128(op, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+        op = _mm_or_si128(op, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+        m.space |= (uint64_t) _mm_movemask_epi8(space) << (16 * i);
+        m.newline |= (uint64_t) _mm_movemask_epi8(newline) << (16 * i);
+        m.op |= (uint64_t) _mm_movemask_epi8(op) << (16 * i);
+    }
+
+    return m;
+}
+
+__attribute__((target("sse2")))
+SCAN_INDEX(sse2)
+
+static const ScanKernels scan_kernels_sse2 = {
+    scan_space_sse2,
+    scan_word_sse2,
+    scan_digits_sse2,
+    scan_index_sse2,
+};
+
+__attribute__((target("avx2")))
+static inline __m256i scan_space_avx2_mask(__m256i v)
+{
+    __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v')));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scan_word_avx2_mask(__m256i v)
+{
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i m = SCAN_RANGE_AVX2(v, '0', '9');
+    m = _mm256_or_si256(m, SCAN_RANGE_AVX2(lower, 'a', 'z'));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scan_digits_avx2_mask(__m256i v)
+{
+    return SCAN_RANGE_AVX2(v, '0', '9');
+}
+
+// Los últimos bytes (menos de 32) se terminan con el núcleo SSE2
+#define SCAN_AVX2(name) \
+    __attribute__((target("avx2"))) \
+    static const char *scan_##name##_avx2(const char *ptr, const char *end) \
+    { \
+        while (end - ptr >= 32) { \
+            __m256i v = _mm256_loadu_si256((const __m256i*) ptr); \
+            unsigned mask = _mm256_movemask_epi8(scan_##name##_avx2_mask(v)); \
+            if (mask != 0xffffffff) { \
+                return ptr + __builtin_ctz(~mask); \
+            } \
+            ptr += 32; \
+        } \
+        return scan_##name##_sse2(ptr, end); \
+    }
+
+SCAN_AVX2(space)
+SCAN_AVX2(word)
+SCAN_AVX2(digits)
+
+__attribute__((target("avx2")))
+static inline ScanMasks scan_masks_avx2(const char *data)
+{
+    ScanMasks m = { 0, 0, 0 };
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) data + i);
+        __m256i space = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            SCAN_RANGE_AVX2(v, '\t', '\r'));
+        __m256i newline = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        __m256i op = _mm256_or_si256(SCAN_RANGE_AVX2(v, '(', '+'),
+                                     SCAN_RANGE_AVX2(v, '<', '>'));
+        op = _mm256_or_si256(op, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+        op = _mm256_or_si256(op, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+        op = _mm256_or_si256(op, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('^')));
+        op = _mm256_or_si256(op, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+        op = _mm256_or_si256(op, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+        m.space |= (uint64_t) (uint32_t) _mm256_movemask_epi8(space) << (32 * i);
+        m.newline |=
+            (uint64_t) (uint32_t) _mm256_movemask_epi8(newline) << (32 * i);
+        m.op |= (uint64_t) (uint32_t) _mm256_movemask_epi8(op) << (32 * i);
+    }
+
+    return m;
+}
+
+__attribute__((target("avx2")))
+SCAN_INDEX(avx2)
+
+static const ScanKernels scan_kernels_avx2 = {
+    scan_space_avx2,
+    scan_word_avx2,
+    scan_digits_avx2,
+    scan_index_avx2,
+};
+
+#endif
+
+// Selecciona en tiempo de ejecución los núcleos que admite el procesador
+const ScanKernels *scan_kernels()
+{
+#ifdef SCAN_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &scan_kernels_avx2;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return &scan_kernels_sse2;
+    }
+#endif
+    return &scan_kernels_scalar;
+}
@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Núcleos que devuelven el final de una secuencia de caracteres de una misma
+// clase a partir de ptr, sin leer más allá de end
+typedef const char *(*ScanFunc)(const char *ptr, const char *end);
+
+// Índice estructural de una entrada completa: un bit por byte en mapas de
+// 64 bits. starts marca los posibles inicios de token (el primer carácter de
+// cada secuencia sin espacios, cada operador o paréntesis y el carácter que le
+// sigue) y newlines los "\r" y "\n".
+typedef void (*ScanIndexFunc)(const char *data, size_t size,
+                              uint64_t *starts, uint64_t *newlines);
+
+typedef struct {
+    ScanFunc space;     // " " | "\t" | "\v" | "\f"
+    ScanFunc word;      // [A-Za-z0-9_]
+    ScanFunc digits;    // [0-9]
+    ScanIndexFunc index;
+} ScanKernels;
+
+const ScanKernels *scan_kernels();
+
+#endif
@@ -1,31 +1,56 @@
 #include "stack.h"
+#include <string.h>
 #include "cdefs.h"
 #include "cmem.h"
 
 ParserStack *parser_stack_new()
 {
     ParserStack *stack = cmalloc(sizeof(*stack));
+    stack->data = stack->inline_data;
     stack->size = 0;
+    stack->capacity = PARSER_STACK_INLINE;
     return stack;
 }
 
 void parser_stack_destroy(ParserStack *stack)
 {
+    if (stack->data != stack->inline_data) {
+        cfree(stack->data);
+    }
+
     cfree(stack);
 }
 
-int *parser_stack_top(ParserStack *stack)
+uint8_t *parser_stack_top(ParserStack *stack)
 {
     return stack->size > 0 ? &stack->data[stack->size - 1] : NULL;
 }
 
-int parser_stack_push(ParserStack *stack, int item)
+// Duplica la capacidad; la primera vez copia el búfer interno al heap
+static void parser_stack_grow(ParserStack *stack)
+{
+    size_t capacity = stack->capacity * 2;
+    if (stack->data == stack->inline_data) {
+        stack->data = cmalloc(capacity);
+        memcpy(stack->data, stack->inline_data, stack->size);
+    } else {
+        stack->data = crealloc(stack->data, capacity);
+    }
+
+    stack->capacity = capacity;
+}
+
+size_t parser_stack_push(ParserStack *stack, uint8_t item)
 {
+    if (stack->size == stack->capacity) {
+        parser_stack_grow(stack);
+    }
+
     stack->data[stack->size++] = item;
     return stack->size;
 }
 
-int parser_stack_pop(ParserStack *stack, int *dest)
+int parser_stack_pop(ParserStack *stack, uint8_t *dest)
 {
     if (stack->size == 0) {
         return FALSE;
@@ -38,3 +63,8 @@ int parser_stack_pop(ParserStack *stack, int *dest)
 
     return TRUE;
 }
+
+void parser_stack_clear(ParserStack *stack)
+{
+    stack->size = 0;
+}
@@ -2,18 +2,25 @@
 #define STACK_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-#define PARSER_STACK_MAX 256
+// Capacidad del búfer interno; al superarla la pila pasa al heap
+#ifndef PARSER_STACK_INLINE
+#define PARSER_STACK_INLINE 64
+#endif
 
 typedef struct {
-    int data[PARSER_STACK_MAX];
+    uint8_t *data;
     size_t size;
+    size_t capacity;
+    uint8_t inline_data[PARSER_STACK_INLINE];
 } ParserStack;
 
 ParserStack *parser_stack_new();
 void parser_stack_destroy(ParserStack *stack);
-int *parser_stack_top(ParserStack *stack);
-int parser_stack_push(ParserStack *stack, int item);
-int parser_stack_pop(ParserStack *stack, int *dest);
+uint8_t *parser_stack_top(ParserStack *stack);
+size_t parser_stack_push(ParserStack *stack, uint8_t item);
+int parser_stack_pop(ParserStack *stack, uint8_t *dest);
+void parser_stack_clear(ParserStack *stack);
 
 #endif
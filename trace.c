@@ -0,0 +1,64 @@
+#include "trace.h"
+#include <string.h>
+#include "cmem.h"
+
+ParserTrace *parser_trace_new(FILE *stream)
+{
+    ParserTrace *trace = cmalloc(sizeof(*trace));
+    trace->stream = stream;
+    trace->head = 0;
+    return trace;
+}
+
+void parser_trace_destroy(ParserTrace *trace)
+{
+    parser_trace_flush(trace);
+    fclose(trace->stream);
+    cfree(trace);
+}
+
+void parser_trace_begin(ParserTrace *trace, const char *name)
+{
+    ParserTraceHeader header;
+    size_t length = strlen(name);
+    if (length > UINT16_MAX) {
+        length = UINT16_MAX;
+    }
+
+    memcpy(header.magic, PARSER_TRACE_MAGIC, sizeof(header.magic));
+    header.version = PARSER_TRACE_VERSION;
+    header.name_length = (uint16_t) length;
+
+    parser_trace_flush(trace);
+    fwrite(&header, sizeof(header), 1, trace->stream);
+    fwrite(name, 1, length, trace->stream);
+}
+
+static void parser_trace_mark(ParserTrace *trace, uint8_t flags)
+{
+    ParserTraceRecord *r = &trace->ring[trace->head];
+    memset(r, 0, sizeof(*r));
+    r->flags = flags;
+    if (++trace->head == PARSER_TRACE_RING_SIZE) {
+        parser_trace_flush(trace);
+    }
+}
+
+void parser_trace_end(ParserTrace *trace)
+{
+    parser_trace_mark(trace, 0);
+}
+
+void parser_trace_reset(ParserTrace *trace)
+{
+    parser_trace_mark(trace, PARSER_TRACE_FLAG_RESET);
+}
+
+// Vuelca al archivo los registros acumulados en un solo bloque
+void parser_trace_flush(ParserTrace *trace)
+{
+    if (trace->head > 0) {
+        fwrite(trace->ring, sizeof(*trace->ring), trace->head, trace->stream);
+        trace->head = 0;
+    }
+}
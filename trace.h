@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lexer.h"
+
+/*
+ * Traza binaria del parser. Cada análisis escribe una sección:
+ *   cabecera (ParserTraceHeader) + nombre del archivo analizado
+ *   un ParserTraceRecord por producción aplicada
+ *   un registro con proc = 0 (sin más indicadores) que cierra la sección
+ * Los campos se escriben en el orden de bytes de la máquina.
+ */
+#define PARSER_TRACE_MAGIC "CTRC"
+#define PARSER_TRACE_VERSION 1
+
+// Registros acumulados antes de volcarlos al archivo
+#ifndef PARSER_TRACE_RING_SIZE
+#define PARSER_TRACE_RING_SIZE 4096
+#endif
+
+// El registro no tiene token: se alcanzó el fin de la secuencia
+#define PARSER_TRACE_FLAG_EOF 0x01
+// Registro con proc = 0 que marca el inicio de una nueva expresión (modo por
+// líneas): la pila vuelve a su estado inicial
+#define PARSER_TRACE_FLAG_RESET 0x02
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t name_length;
+} ParserTraceHeader;
+
+typedef struct {
+    uint64_t offset;        // Posición del token actual en la entrada
+    uint32_t length;        // Longitud del token actual
+    uint8_t proc;           // Número de producción
+    uint8_t type;           // TokenType del token actual
+    int8_t delta;           // Variación de la profundidad de la pila
+    uint8_t flags;
+} ParserTraceRecord;
+
+typedef struct {
+    FILE *stream;
+    size_t head;
+    ParserTraceRecord ring[PARSER_TRACE_RING_SIZE];
+} ParserTrace;
+
+ParserTrace *parser_trace_new(FILE *stream);
+void parser_trace_destroy(ParserTrace *trace);
+void parser_trace_begin(ParserTrace *trace, const char *name);
+void parser_trace_end(ParserTrace *trace);
+void parser_trace_reset(ParserTrace *trace);
+void parser_trace_flush(ParserTrace *trace);
+
+// Camino rápido: un registro de 16 bytes en el anillo, sin formatear nada
+static inline void parser_trace_record(ParserTrace *trace, int proc,
+                                       int delta, const Token *t)
+{
+    ParserTraceRecord *r = &trace->ring[trace->head];
+    if (t != NULL) {
+        r->offset = t->offset;
+        r->length = (uint32_t) t->length;
+        r->type = (uint8_t) t->type;
+        r->flags = 0;
+    } else {
+        r->offset = 0;
+        r->length = 0;
+        r->type = 0;
+        r->flags = PARSER_TRACE_FLAG_EOF;
+    }
+
+    r->proc = (uint8_t) proc;
+    r->delta = (int8_t) delta;
+    if (++trace->head == PARSER_TRACE_RING_SIZE) {
+        parser_trace_flush(trace);
+    }
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "cdefs.h"
+#include "cmem.h"
+#include "parser.h"
+#include "stack.h"
+#include "trace.h"
+
+#define TEXT_DELIM "--------------------------------\n"
+
+static const char *program = "c-ompiler-trace";
+
+// Mismo formato que la traza en texto de c-ompiler
+static void print_stack(const char *name, ParserStack *stack)
+{
+    printf("%s: Pila -> {", name);
+    for (size_t i = stack->size; i > 0; i--) {
+        printf(i > 1 ? "%d, " : "%d", stack->data[i - 1]);
+    }
+
+    fputs("}\n", stdout);
+}
+
+// Lee el archivo fuente completo; NULL si no se puede abrir
+static char *read_source(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: ", program);
+        perror(path);
+        return NULL;
+    }
+
+    size_t capacity = 65536;
+    char *data = cmalloc(capacity);
+    *size = 0;
+    size_t nread;
+    while ((nread = fread(data + *size, 1, capacity - *size, f)) > 0) {
+        *size += nread;
+        if (*size == capacity) {
+            capacity *= 2;
+            data = crealloc(data, capacity);
+        }
+    }
+
+    fclose(f);
+    return data;
+}
+
+static void print_record(const char *name, const ParserTraceRecord *r,
+                         ParserStack *stack, const char *source,
+                         size_t size)
+{
+    printf("%s: Inicio procedimiento %d\n", name, r->proc);
+    print_stack(name, stack);
+
+    if (r->flags & PARSER_TRACE_FLAG_EOF) {
+        printf("%s: Fin de secuencia\n", name);
+    } else if (source != NULL && r->offset + r->length <= size) {
+        printf("%s: Token -> `%.*s` (tipo %d)\n", name, (int) r->length,
+               source + r->offset, r->type);
+    } else {
+        printf("%s: Token -> <%llu+%u> (tipo %d)\n", name,
+               (unsigned long long) r->offset, r->length, r->type);
+    }
+
+    // Se repite la producción sobre la pila reconstruida
+    const ParserProduction *prod = &parser_productions[r->proc];
+    parser_stack_pop(stack, NULL);
+    for (int i = 0; i < prod->count; i++) {
+        parser_stack_push(stack, prod->push[i]);
+    }
+
+    print_stack(name, stack);
+    printf("%s: Fin procedimiento %d\n", name, r->proc);
+    printf(TEXT_DELIM);
+}
+
+// Decodifica una sección. Devuelve FALSE al final del archivo o si la traza
+// está dañada.
+static int decode_section(FILE *f, const char *source_path)
+{
+    ParserTraceHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1) {
+        return FALSE;
+    }
+
+    if (memcmp(header.magic, PARSER_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PARSER_TRACE_VERSION)
+    {
+        fprintf(stderr, "%s: formato de traza no reconocido\n", program);
+        return FALSE;
+    }
+
+    char *name = cmalloc(header.name_length + 1);
+    if (fread(name, 1, header.name_length, f) != header.name_length) {
+        fprintf(stderr, "%s: traza truncada\n", program);
+        cfree(name);
+        return FALSE;
+    }
+
+    name[header.name_length] = '\0';
+    if (source_path == NULL && strcmp(name, "STDIN") != 0) {
+        source_path = name;
+    }
+
+    size_t size = 0;
+    char *source = NULL;
+    if (source_path != NULL) {
+        source = read_source(source_path, &size);
+    } else {
+        fprintf(stderr, "%s: %s: falta el archivo fuente, se muestran "
+                "posiciones\n", program, name);
+    }
+
+    ParserStack *stack = parser_stack_new();
+    parser_stack_push(stack, PARSER_SYMBOL_BOTTOM);
+    parser_stack_push(stack, PARSER_SYMBOL_NONTERM_A);
+
+    static ParserTraceRecord records[PARSER_TRACE_RING_SIZE];
+    int ok = FALSE;
+    int done = FALSE;
+    size_t count;
+    long start = ftell(f);
+    while (!done && (count = fread(records, sizeof(*records),
+                                   PARSER_TRACE_RING_SIZE, f)) > 0)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const ParserTraceRecord *r = &records[i];
+            if (r->proc == 0 && (r->flags & PARSER_TRACE_FLAG_RESET)) {
+                parser_stack_clear(stack);
+                parser_stack_push(stack, PARSER_SYMBOL_BOTTOM);
+                parser_stack_push(stack, PARSER_SYMBOL_NONTERM_A);
+                continue;
+            } else if (r->proc == 0) {
+                // Fin de sección: lo leído de más se devuelve al archivo
+                fseek(f, start + (long) ((i + 1) * sizeof(*records)),
+                      SEEK_SET);
+                ok = done = TRUE;
+                break;
+            }
+
+            if (r->proc >= PARSER_PROC_COUNT ||
+                r->delta != parser_productions[r->proc].count - 1)
+            {
+                fprintf(stderr, "%s: %s: registro inválido\n", program, name);
+                done = TRUE;
+                break;
+            }
+
+            print_record(name, r, stack, source, size);
+        }
+
+        start += (long) (count * sizeof(*records));
+    }
+
+    if (!done) {
+        fprintf(stderr, "%s: %s: traza truncada\n", program, name);
+    }
+
+    parser_stack_destroy(stack);
+    cfree(source);
+    cfree(name);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s TRAZA [FUENTE...]\n", program);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: ", program);
+        perror(argv[1]);
+        return 1;
+    }
+
+    // Las fuentes indicadas sustituyen, en orden, a las de cada sección
+    int next_source = 2;
+    while (decode_section(f, next_source < argc ? argv[next_source] : NULL)) {
+        next_source++;
+    }
+
+    fclose(f);
+    return 0;
+}